@@ -1,4 +1,7 @@
 
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "tinytest.h"
 
 TT_DECLARE_MODULE("tt_main.cpp");
@@ -53,6 +56,199 @@ void testAssertStrFail() {
 	TT_ASSERT_STR("zzz", "aaa"); 
 }
 
+static int* table;
+static void suiteSetup() {
+	int i;
+	ttDiagnostic("In suiteSetup().");
+	table = (int*)malloc(1000 * sizeof(int));
+	TT_ASSERT(NULL != table);
+	for (i = 0; i < 1000; ++i)
+		table[i] = i * i;
+}
+static void suiteTeardown() {
+	ttDiagnostic("In suiteTeardown().");
+	free(table);
+	table = NULL;
+}
+static void suiteSetupFail() {
+	TT_FAIL("Cannot load table");
+}
+void testSuite1() {
+	TT_ASSERT_INT(table[10], 100);
+}
+void testSuite2() {
+	TT_ASSERT_INT(table[999], 998001);
+}
+
+/* With `-C <dir>' the first test of a suite covers its fixtures, so `mk_test.py --impact' selects testSuiteCovered() for a change
+	that is only in suiteCoveredSetup(). */
+static int suiteLimit;
+static void suiteCoveredSetup() {
+	suiteLimit = 100;
+}
+void testSuiteCovered() {
+	TT_ASSERT_INT(suiteLimit, 100);
+}
+
+void testAllocOk() {
+	char* p;
+	TT_ASSERT_NO_ALLOC(TT_ASSERT_INT(1, 1));
+	p = (char*)malloc(100);
+	TT_ASSERT(NULL != p);
+	free(p);
+	TT_ASSERT_MAX_ALLOC_BYTES(100);
+}
+void testAllocFail() {
+	char* p;
+	TT_ASSERT_NO_ALLOC(p = (char*)malloc(10); free(p));
+}
+void testAllocLeak() {
+	TT_ASSERT(NULL != malloc(10));
+}
+
+static int recurse(int n) {
+	volatile char buf[64];
+	buf[0] = (char)n;
+	return (n > 0) ? recurse(n - 1) + buf[0] : 0;
+}
+void testStackDeep() {
+	TT_ASSERT_INT(recurse(100), 5050);
+}
+
+void testVerifyMemoryOk() {
+	char buf[37];
+	ttFillMemory(buf + 1, sizeof(buf) - 1, 1234);
+	TT_VERIFY_MEMORY(buf + 1, sizeof(buf) - 1, 1234);
+}
+void testVerifyMemoryFail() {
+	char buf[64];
+	ttFillMemory(buf, sizeof(buf), 1234);
+	buf[3] = 0;
+	memset(buf + 20, 0xff, 5);
+	TT_VERIFY_MEMORY(buf, sizeof(buf), 1234);
+}
+void testGuardsFail() {
+	char mem[TT_GUARD_SIZE + 10 + TT_GUARD_SIZE];
+	char* buf = mem + TT_GUARD_SIZE;
+	ttFillGuards(buf, 10, TT_GUARD_SIZE);
+	memset(buf, 0, 11);
+	TT_VERIFY_GUARDS(buf, 10, TT_GUARD_SIZE);
+}
+
+void testMemOk() {
+	static unsigned char frame[100000], copy[100000];
+	memset(frame, 0x55, sizeof(frame));
+	memcpy(copy, frame, sizeof(copy));
+	TT_ASSERT_MEM(copy, frame, sizeof(frame));
+}
+void testMemFail() {
+	static unsigned char frame[100000], copy[100000];
+	memset(frame, 0x55, sizeof(frame));
+	memcpy(copy, frame, sizeof(copy));
+	copy[50000] = 0;
+	copy[50003] = 0;
+	copy[99999] = 0;
+	TT_ASSERT_MEM(copy, frame, sizeof(frame));
+}
+void testFloatsOk() {
+	const float expected[4] = { 1.0f, INFINITY, -INFINITY, NAN };
+	float actual[4];
+	memcpy(actual, expected, sizeof(actual));
+	TT_ASSERT_FLOATS(actual, expected, 4, 0.001f);
+}
+void testFloatsFail() {
+	float expected[20], actual[20];
+	int i;
+	for (i = 0; i < 20; ++i)
+		expected[i] = actual[i] = (float)i * 0.25f;
+	actual[10] += 0.01f;
+	actual[11] = -1e-6f;
+	TT_ASSERT_FLOATS(actual, expected, 20, 0.001f);
+}
+
+static volatile unsigned long sink;
+static void work(int n) {
+	int i;
+	for (i = 0; i < n; ++i)
+		sink += (unsigned long)i;
+}
+void testBudgetOk() {
+	TT_ASSERT_MAX_NS(1000000) {
+		work(10);
+	}
+}
+void testBudgetFail() {
+	TT_ASSERT_MAX_CYCLES(100) {
+		work(10000);
+	}
+}
+
+static volatile unsigned long counter;
+static void increment(int thread, unsigned long iteration) {
+	(void)thread;
+	(void)iteration;
+	__sync_fetch_and_add(&counter, 1UL);
+}
+void testConcurrentOk() {
+	counter = 0;
+	ttRunConcurrent(increment, 4, 100000);
+	TT_ASSERT_INT(counter, (1 + 2 + 4) * 100000);
+}
+static void failOnThread2(int thread, unsigned long iteration) {
+	TT_ASSERT((2 != thread) || (iteration < 1000));
+}
+void testConcurrentFail() {
+	ttRunConcurrent(failOnThread2, 4, 100000);
+}
+
+static void addCommutes(tt_prop_t* p) {
+	long a = ttPropInt(p, -1000000, 1000000), b = ttPropInt(p, -1000000, 1000000);
+	TT_ASSERT_INT(a + b, b + a);
+}
+void testPropertyOk() {
+	ttCheckProperty(addCommutes, 1000000);
+}
+static void stringsAreShort(tt_prop_t* p) {
+	char s[32];
+	ttPropString(p, s, sizeof(s));
+	ttDiagnostic("%s", s);
+	TT_ASSERT(strlen(s) < 10);
+}
+void testPropertyFail() {
+	ttCheckProperty(stringsAreShort, 1000);
+}
+
+typedef struct { int x, square; } square_case_t;
+static const square_case_t SQUARE_CASES[] TT_ATTR_PGM = { { 2, 4 }, { 3, 9 }, { -4, 15 } };
+static void squareRun(const tt_test_table_t* table, unsigned index) {
+	square_case_t c;
+	tt_pgm_read_mem(&c, (const square_case_t*)table->cases + index, sizeof(c));
+	TT_ASSERT_INT(c.x * c.x, c.square);
+}
+static void squareDescribe(const tt_test_table_t* table, unsigned index) {
+	square_case_t c;
+	tt_pgm_read_mem(&c, (const square_case_t*)table->cases + index, sizeof(c));
+	tt_printf(TT_PSTR("testSquare(%d, %d)"), c.x, c.square);
+}
+static const tt_test_table_t SQUARE_TABLE = { 
+	"testSquare()", SQUARE_CASES, sizeof(square_case_t), sizeof(SQUARE_CASES) / sizeof(SQUARE_CASES[0]), __LINE__, squareRun, squareDescribe, NULL 
+};
+
+TT_TEST(testRegisteredOk) {
+	TT_ASSERT_INT(ttRegisteredTestCount(), 2);
+}
+TT_TEST(testRegisteredFail) {
+	TT_ASSERT_STR("registered", "listed");
+}
+
+void benchAssertInt(tt_bench_t* b) {
+	unsigned long i;
+	for (i = 0; i < b->iterations; ++i) {
+		TT_ASSERT_INT(i, i);
+		TT_DO_NOT_OPTIMIZE(i);
+	}
+}
+
 void ttRunTests(void) {
 	TT_TEST_SIMPLE(testDiag);
 	TT_TEST_SIMPLE(testAssertOk);
@@ -74,6 +270,37 @@ void ttRunTests(void) {
 	TT_TEST_SIMPLE(testAssertIntFail2);
 	TT_TEST_SIMPLE(testAssertHexFail);
 	TT_TEST_SIMPLE(testAssertStrFail);
+
+	ttBeginSuite(suiteSetup, suiteTeardown);
+		TT_TEST_SIMPLE(testSuite1);
+		TT_TEST_SIMPLE(testSuite2);
+	ttBeginSuite(suiteSetupFail, suiteTeardown);
+		TT_TEST_SIMPLE(testSuite1);
+	ttBeginSuite(suiteCoveredSetup, NULL);
+		TT_TEST_SIMPLE(testSuiteCovered);
+	ttEndSuite();
+
+	TT_TEST_SIMPLE(testAllocOk);
+	TT_TEST_SIMPLE(testAllocFail);
+	TT_TEST_SIMPLE(testAllocLeak);
+	TT_TEST_SIMPLE(testStackDeep);
+	TT_TEST_SIMPLE(testVerifyMemoryOk);
+	TT_TEST_SIMPLE(testVerifyMemoryFail);
+	TT_TEST_SIMPLE(testGuardsFail);
+	TT_TEST_SIMPLE(testMemOk);
+	TT_TEST_SIMPLE(testMemFail);
+	TT_TEST_SIMPLE(testFloatsOk);
+	TT_TEST_SIMPLE(testFloatsFail);
+	TT_TEST_SIMPLE(testBudgetOk);
+	TT_TEST_SIMPLE(testBudgetFail);
+	TT_TEST_SIMPLE(testConcurrentOk);
+	TT_TEST_SIMPLE(testConcurrentFail);
+	ttRunTestTable(&SQUARE_TABLE, TT_FILENAME);
+	TT_TEST_SIMPLE(testPropertyOk);
+	TT_TEST_SIMPLE(testPropertyFail);
+	ttRunRegisteredTests();
+
+	TT_BENCH_SIMPLE(benchAssertInt);
 }
 
 int main(int argc, char* argv[]) {	
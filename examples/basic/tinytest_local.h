@@ -27,6 +27,8 @@
 		Tinytest may be used on targets with no printf! So it defines it's own minimal vprintf, which you don't have to use if you have one available. 
 		The only format specifiers used are `%s' and whatever you have defined for TT_FMT_INT, TT_FMT_HEX, TT_FMT_PSTR. 
 		If the macro TT_VPRINTF(fmt, args) is defined then it is used, else tinytest uses its minimal vprintf. 
+		The minimal vprintf handles `%[-][0][width][l|ll]' followed by `d', `u', `x', `X', `c' or `s', and converts numbers without division. 
+		Define `TT_VPRINTF_NO_LONG_LONG' if 64 bit values are not needed, this makes it smaller & faster. 
 		Note that the format string is of type `tt_pgm_str_t', so this must be set correctly. 
 		
 	Pgm strings:
@@ -40,6 +42,7 @@
 		The `tt_pgm_str_read()' macro reads a char from a pgm string address. If not defined it defaults to simple pointer derefence. 
 		The `TT_FMT_PSTR' macro is the printf format used for such strings. It defaults to `"%s"'.
 		The `tt_strcmp_pstr macro must be set to a function with prototype int f(tt_pgm_str_t, const char*), if not set it defaults to strcmp(*). 
+		The `tt_pgm_read_mem()' macro copies n bytes from pgm memory to RAM, e.g. a case of a test table. It defaults to memcpy(). 
 		
 		void f(tt_pgm_str_t str) { ... }
 		tt_pgm_str_t str TT_ATTR_PGM = TT_PSTR(" ... ");
@@ -51,6 +54,94 @@
 		Tinytest has a main function that allows running tests with options for output verbosity and whether to pause before exiting. 
 		If you want this function included then the macro `TT_WANT_TT_MAIN' must be defined _and_ the macro `tt_wait_enter()' must be defined to 
 		`getchar()' or similar. 
+
+	Parallel running:
+		On POSIX hosts define `TT_WANT_FORK' to add the `-j N' option to tt_main(), which runs tests in N forked worker processes. 
+		This requires that all output goes to stdout. It also adds the `-x' option, which runs each test in a child forked from the 
+		initialised process, so that a test that crashes or calls exit() fails with the reason and the remaining tests still run. 
+		Define `TT_WANT_THREADS' to add the `-m N' option, which runs tests on N threads in this process with pthreads, so they can share 
+		expensive read-only setup. Each thread has its own test context, output is captured & printed in test order, which needs 
+		tinytest's own vprintf. Tests that are not thread safe are marked with TT_SERIAL() and run alone on the main thread, only these
+		have the watchdog & `-x' isolation. It also adds ttRunConcurrent(), which stress tests concurrent code on several threads.
+
+	Timing:
+		If the macro `tt_clock()' is defined then each test is timed, verbose mode prints the time for each test and the summary lists the 
+		slowest tests & the total time. The `-t <ms>' option for tt_main() fails tests that take longer. `tt_clock()' returns a free running 
+		microsecond count of type `tt_clock_t', which defaults to `unsigned long'. The optional `tt_cpu_clock()' is the same for CPU time. 
+		Define `TT_CLOCK_POSIX' to use clock_gettime() for both. `TT_SLOWEST_COUNT' sets the number of slow tests listed, default 5. 
+		
+	Watchdog:
+		If the macros `tt_watchdog_start(ms)' & `tt_watchdog_stop()' are defined then the `-w <ms>' option for tt_main() stops a test that 
+		runs for longer and counts it as timed out. On a target start a hardware timer or watchdog interrupt that calls ttWatchdogExpired(), 
+		which jumps out of the test. Define `TT_WATCHDOG_POSIX' to use setitimer() & SIGALRM. A test stuck holding a lock, e.g. inside 
+		malloc(), might leave the process unusable, use `-x' as well to be safe. TT_TIMEOUT(ms) sets the timeout for one test. 
+		
+	Allocation tracking:
+		Define `TT_WANT_ALLOC' and have the allocator call ttNoteAlloc() & ttNoteFree() to count allocations, bytes & peak bytes in use 
+		for each test, which are printed in verbose mode and the summary. Tests that leak fail, and the assertions TT_ASSERT_NO_ALLOC() & 
+		TT_ASSERT_MAX_ALLOC_BYTES() check allocations. With the GNU linker define `TT_ALLOC_WRAP' instead and link with 
+		`-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free' to track the standard allocator. `TT_ALLOC_TRACK_MAX' is the 
+		number of live blocks tracked, default 256, beyond that allocations are counted but leaks & peak are not exact.
+		
+	Stack measurement:
+		If the macro `tt_stack_bounds(lo, hi)' is defined to set the char pointers lo & hi to the lowest address of the stack & one past the
+		highest, then before each test the free stack is painted with `TT_STACK_PAINT' (default 0xcd), and afterwards it is scanned for 
+		the deepest byte written. Verbose mode prints the stack used by each test, the summary prints the deepest, and the `-s <bytes>' 
+		option for tt_main() fails tests that use more. Define `TT_STACK_GROWS_UP' if the stack grows up. At most `TT_STACK_PAINT_MAX' 
+		bytes are painted (default 64K), so painting a large host stack is not slow. Define `TT_STACK_PTHREAD' to get the bounds from 
+		pthread_getattr_np(). On AVR, lo is `__brkval' if the heap is used, or else `&__heap_start', and hi is `(char*)RAMEND + 1'. 
+		
+	Budget assertions:
+		TT_ASSERT_MAX_CYCLES(n) { ... } fails if the median of `TT_BUDGET_REPEATS' (default 11) runs of the block takes more than n cycles.
+		This needs `tt_cycles()', a free running counter returning unsigned long, with `TT_CYCLES_MASK' set to the width of the counter if 
+		it is less than an unsigned long, e.g. 0xffff. TT_ASSERT_MAX_NS(n) needs `tt_ns()' returning nanoseconds. Define `TT_CYCLES_RDTSC' 
+		on x86, `TT_CYCLES_DWT' on Cortex-M3 & later, or `TT_CYCLES_POSIX' for clock_gettime(), which supplies `tt_ns()' & supplies 
+		`tt_cycles()' if not defined otherwise. On AVR start timer 1 with no prescaler, `TCCR1B = _BV(CS10)', and define `tt_cycles()' 
+		as `TCNT1'. 
+		
+	Performance counters:
+		On Linux define `TT_WANT_PERF' to count instructions, cycles, cache misses, branch misses & page faults in user space for each 
+		test with perf_event_open(). Verbose mode prints the counts, and results files have a `perf' line after each test. Counters that 
+		are not available, e.g. in a VM or if /proc/sys/kernel/perf_event_paranoid forbids them, are quietly left out. 
+		
+	Benchmarks:
+		These need `tt_clock()'. Benchmarks are run with the `-b' option. Each sample is calibrated to take about `TT_BENCH_SAMPLE_TIME' 
+		microseconds (default 10000), `TT_BENCH_WARMUPS' samples are discarded (default 1) and `TT_BENCH_SAMPLES' samples (default 9) are 
+		measured. `TT_BENCH_MAX_ITERATIONS' limits the number of iterations in a sample. 
+		
+	Results files:
+		On hosted systems define `TT_WANT_FILES' to add the `-o <file>' option to tt_main() that writes results of tests & benchmarks to a file,
+		and the `-r <file>' option that compares benchmarks with a previous results file. Benchmarks slower than `-R <percent>' (default 
+		`TT_BENCH_THRESHOLD', 10%) are remeasured up to `TT_BENCH_RETRIES' times (default 2) and fail if still slow. 
+		It also adds ttRunTestVectors(), which runs a test for each record in a file of test vectors that is mapped with POSIX mmap(). 
+		The test times in a `-r' file also balance the shards of the `-n i/n' option, see ttSetShard(). 
+		The tests that fail are kept in `TT_LAST_FAILED_FILE' (default `.tinytest-failed') for the `-F' option, which runs them first, 
+		& the `-L' option, which only runs them. 
+
+	Registered tests:
+		With GCC or clang & the GNU linker define `TT_WANT_REGISTRY' to add TT_TEST(name) { ... }, which defines a test & puts its 
+		descriptor in the linker section `tt_tests', so that no list of tests is needed. ttRunRegisteredTests() runs them, & is the 
+		default ttRunTests(). It also adds the `-l' option to tt_main() that lists the tests with their index, & `-i <index>' that runs 
+		only one of them. `TT_ATTR_REGISTRY' is the attribute that places a descriptor in the section, it may be redefined, 
+		e.g. to add `retain' if the linker removes unused sections. 
+
+	Coverage of each test:
+		With `TT_WANT_FILES' define `TT_COVERAGE_GCOV' & build with `--coverage' for gcc, or define `TT_COVERAGE_LLVM' & build with 
+		`-fprofile-instr-generate -fcoverage-mapping' for clang, or define `tt_coverage_reset()' & `tt_coverage_dump(dir)' for another 
+		tool. This adds the `-C <dir>' option to tt_main(), which dumps the coverage of each test to its own directory, see 
+		ttCaptureCoverage(). Then `mk_test.py --impact -C <dir> [-b <binary>] [diff]' selects the tests that cover the lines changed by 
+		a diff, & writes them in the format of `TT_LAST_FAILED_FILE', so that the `-L' option runs them, e.g. 
+		`git diff -U0 | mk_test.py --impact -C tt-coverage -o .tinytest-failed && ./test -L'. 
+
+	Property tests:
+		ttCheckProperty() records up to `TT_PROP_MAX_BYTES' (default 1024) bytes of input for each run of a property, on the stack, & 
+		makes up to `TT_PROP_SHRINK_RUNS' (default 5000) runs to shrink a failing input. 
+
+	Tokenized output:
+		For targets with a slow serial link define `TT_WANT_TOKENS'. Results, failure messages & diagnostics are then sent through tt_putchar() 
+		as short binary records with no text formatting on the target. Failure messages no longer include the text of the failed expression, 
+		which saves a lot of Flash. Decode the output on the host with `mk_test.py --decode [-v|-c] [-s srcdir] [logfile]' run in the directory
+		of the test sources. In this mode ttDiagnostic() is a macro that needs a string literal on the same line, with int arguments only. 
 */
 
 /* Tinytest can include appropriate configuration, or you can do it all yourself. */
@@ -70,7 +161,7 @@
 /* Use tinytest's vprintf. */
 #undef TT_VPRINTF
 #define TT_FMT_PSTR "%P"
-#define TT_VPRINTF_BUFLEN (10) /* Make sure that the maximum number can fit in here! */
+#define TT_VPRINTF_NO_LONG_LONG
 
 #include <pgmspace.h>
 #define tt_pgm_str_t PGM_P				// From pgmspace.h, I think it's actually `const char*'. 
@@ -78,10 +169,14 @@
 #define TT_PSTR(_s) PSTR(_s)		// From pgmspace.h.
 #define tt_pgm_str_read(_s) ((char)pgm_read_byte((_s))) 		// From pgmspace.h.
 #define tt_strcmp_pstr(_ps, _s) (strcmp_P(_ps, _s))	// From pgmspace.h, not string.h as you might think. 
+#define tt_pgm_read_mem(_d, _s, _n) (memcpy_P(_d, _s, _n))	// From pgmspace.h.
 
 /* No tt_main(). */
 #undef TT_WANT_TT_MAIN
 #undef tt_wait_enter
+#undef TT_WANT_FORK
+#undef TT_WANT_THREADS
+#undef TT_WANT_FILES
 
 #else
 
@@ -105,7 +200,6 @@
 #undef TT_VPRINTF
 #define tt_putchar(_c) putchar(_c)
 #undef TT_FMT_PSTR
-#define TT_VPRINTF_BUFLEN (10) /* Make sure that the maximum number can fit in here! */
 #endif
 
 /* Use normal strings. */
@@ -114,11 +208,49 @@
 #undef TT_PSTR
 #undef tt_pgm_str_read
 #undef tt_strcmp_pstr
+#undef tt_pgm_read_mem
 
 /* Use tt_main(). */
 #define TT_WANT_TT_MAIN
 #define tt_wait_enter() (getchar())
 
+/* Allow running tests in parallel processes. */
+#define TT_WANT_FORK
+
+/* Time tests with clock_gettime(). */
+#define TT_CLOCK_POSIX
+
+/* Allow writing & reading results files. */
+#define TT_WANT_FILES
+
+/* Allow running tests on a thread pool, link with -pthread. */
+#define TT_WANT_THREADS
+
+/* Allow registering tests with TT_TEST(), which needs the GNU linker. */
+#if defined(__GNUC__) && defined(__ELF__)
+#define TT_WANT_REGISTRY
+#endif
+
+/* Stop tests that hang with a timer signal. */
+#define TT_WATCHDOG_POSIX
+
+/* Measure stack use, with the bounds from pthreads. */
+#define TT_STACK_PTHREAD
+
+/* Cycle counters for budget assertions. */
+#if defined(__x86_64__) || defined(__i386__)
+#define TT_CYCLES_RDTSC
+#endif
+#define TT_CYCLES_POSIX
+
+/* Performance counters for each test. */
+#ifdef __linux__
+#define TT_WANT_PERF
+#endif
+
+/* Track allocations by wrapping malloc() & friends, see LDFLAGS in the makefile. */
+#define TT_ALLOC_WRAP
+
 #endif
 
 #endif /* TINYTEST_LOCAL_H__ */
@@ -0,0 +1,109 @@
+#include <string.h>
+#include <limits.h>
+
+#include "tinytest.h"
+
+TT_DECLARE_MODULE("printf.c");
+
+/* Output from tt_putchar() goes to stdout, unless it is captured into a buffer, or discarded for benchmarks. */
+enum { OUT_STDOUT, OUT_CAPTURE, OUT_DISCARD };
+static int f_out = OUT_STDOUT;
+static char f_buf[128];
+static size_t f_len;
+static volatile char f_sink;
+
+void example_putchar(char c) {
+	switch (f_out) {
+	case OUT_CAPTURE:
+		if (f_len < sizeof(f_buf) - 1)
+			f_buf[f_len++] = c;
+		f_buf[f_len] = '\0';
+		break;
+	case OUT_DISCARD:
+		f_sink = c;
+		break;
+	default:
+		putchar(c);
+		break;
+	}
+}
+
+static void capture(void) { f_out = OUT_CAPTURE; f_len = 0; f_buf[0] = '\0'; }
+static void discard(void) { f_out = OUT_DISCARD; }
+static void restore(void) { f_out = OUT_STDOUT; }
+
+// Format with tt_printf() into the capture buffer and check the result.
+#define CHECK_FORMAT(expected_, ...) do { \
+	capture(); \
+	tt_printf(__VA_ARGS__); \
+	restore(); \
+	TT_ASSERT_STR(f_buf, expected_); \
+} while (0)
+
+void testDecimal() {
+	CHECK_FORMAT("0", "%d", 0);
+	CHECK_FORMAT("123 -456", "%d %d", 123, -456);
+	CHECK_FORMAT("2147483647 -2147483648", "%d %d", INT_MAX, INT_MIN);
+	CHECK_FORMAT("4294967295", "%u", UINT_MAX);
+	CHECK_FORMAT("-1 4294967295", "%ld %lu", -1L, 4294967295UL);
+}
+void testLongLong() {
+	CHECK_FORMAT("9223372036854775807", "%lld", LLONG_MAX);
+	CHECK_FORMAT("-9223372036854775808", "%lld", LLONG_MIN);
+	CHECK_FORMAT("18446744073709551615", "%llu", ULLONG_MAX);
+	CHECK_FORMAT("10000000000000000000", "%llu", 10000000000000000000ULL);
+}
+void testHex() {
+	CHECK_FORMAT("0 ff FF", "%x %x %X", 0, 0xff, 0xff);
+	CHECK_FORMAT("000000ff", "%08x", 0xff);
+	CHECK_FORMAT("deadbeef", "%x", 0xdeadbeef);
+	CHECK_FORMAT("123456789abcdef0", "%llx", 0x123456789abcdef0ULL);
+}
+void testWidth() {
+	CHECK_FORMAT("   42|42   |00042", "%5d|%-5d|%05d", 42, 42, 42);
+	CHECK_FORMAT("  -42|-0042", "%5d|%05d", -42, -42);
+	CHECK_FORMAT("  abc|abc  |x", "%5s|%-5s|%c", "abc", "abc", 'x');
+	CHECK_FORMAT("12345", "%3d", 12345);
+	CHECK_FORMAT("100%", "%d%%", 100);
+}
+
+/* Benchmarks of a single conversion, output is discarded. */
+#define BENCH_FORMAT(b_, ...) do { \
+	unsigned long i; \
+	discard(); \
+	for (i = 0; i < (b_)->iterations; ++i) \
+		tt_printf(__VA_ARGS__); \
+	restore(); \
+} while (0)
+
+void benchDecimal(tt_bench_t* b) { BENCH_FORMAT(b, "%d", -1234567890); }
+void benchLongLong(tt_bench_t* b) { BENCH_FORMAT(b, "%llu", 12345678901234567890ULL); }
+void benchHex(tt_bench_t* b) { BENCH_FORMAT(b, "%08x", 0x1234abcdU); }
+void benchString(tt_bench_t* b) { BENCH_FORMAT(b, "%-10s", "abcdef"); }
+
+// For comparison, the same decimal conversion with the C library.
+void benchSnprintfDecimal(tt_bench_t* b) {
+	unsigned long i;
+	char buf[16];
+	for (i = 0; i < b->iterations; ++i) {
+		snprintf(buf, sizeof(buf), "%d", -1234567890);
+		TT_DO_NOT_OPTIMIZE(buf[0]);
+	}
+}
+
+void ttRunTests(void) {
+	TT_TEST_SIMPLE(testDecimal);
+	TT_TEST_SIMPLE(testLongLong);
+	TT_TEST_SIMPLE(testHex);
+	TT_TEST_SIMPLE(testWidth);
+
+	TT_BENCH_SIMPLE(benchDecimal);
+	TT_BENCH_SIMPLE(benchLongLong);
+	TT_BENCH_SIMPLE(benchHex);
+	TT_BENCH_SIMPLE(benchString);
+	TT_BENCH_SIMPLE(benchSnprintfDecimal);
+}
+
+int main(int argc, char* argv[]) {	
+	return ttMain(argc, argv);
+}
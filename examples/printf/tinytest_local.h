@@ -0,0 +1,33 @@
+/*  Tinytest -- A very simple test harness for embedded systems.
+     See LICENSE.TXT for license.
+*/
+
+/* Local configuration for the printf example, which tests & benchmarks Tinytest's internal vprintf on the host. */
+
+#ifndef TINYTEST_LOCAL_H__
+#define TINYTEST_LOCAL_H__
+
+#include <stdio.h>
+
+#define tt_int_t int
+
+/* Printf formats for decimal & hex int type.  */
+#define TT_FMT_INT "%d"
+#define TT_FMT_HEX "%08x"		// 32 bit ints. 
+
+/* String for a newline. */
+#define TT_NEWLINE "\n"
+
+/* Use tinytest's vprintf, with output that can be captured by the tests. */
+#undef TT_VPRINTF
+void example_putchar(char c);
+#define tt_putchar(_c) example_putchar(_c)
+
+/* Use tt_main(). */
+#define TT_WANT_TT_MAIN
+#define tt_wait_enter() (getchar())
+
+/* Time tests with clock_gettime(), needed for benchmarks. */
+#define TT_CLOCK_POSIX
+
+#endif /* TINYTEST_LOCAL_H__ */
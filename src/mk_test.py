@@ -1,4 +1,4 @@
-import re, sys, os, glob
+import re, sys, os, glob, json, hashlib
 
 # WARNING: I am not writing a generic "C" parser so do not go overboard on the functions. In particular keep it all 
 # on one line. 'void test_foo(void)' will work just fine.
@@ -10,126 +10,812 @@ reTestFunction = re.compile(r"""
 	([^)]*?)	# Possible arguments.
 	\)			# Closing bracket.
 	""", re.X)
-reTtMacros = re.compile(r'(TT_BEGIN_FIXTURE|TT_END_FIXTURE|TT_TEST_CASE|TT_DUMP_FUNC|TT_IGNORE_FILE|TT_INCLUDE_EXTRA)(.*)')
+reBenchFunction = re.compile(r"""
+	void		# Return type void.
+	\s+			# Whitespace.
+	(bench\w+)	# Function name .
+	\s*\(		# Possible whitespace & opening bracket.
+	([^)]*?)	# Argument, which must be a `tt_bench_t*'.
+	\)			# Closing bracket.
+	""", re.X)
+reTtMacros = re.compile(r'(TT_BEGIN_FIXTURE|TT_END_FIXTURE|TT_TEST_CASE|TT_DUMP_FUNC|TT_IGNORE_FILE|TT_INCLUDE_EXTRA|TT_TIMEOUT|TT_SERIAL|TT_TEST_VECTORS)(.*)')
 
 def error(msg):
 	sys.exit(msg)
+
+# Decoder for the tokenized output of a target built with TT_WANT_TOKENS, see tinytest.h for the record format. Text that is not 
+# sent by the target is recovered from the source files, so they must be the same as those used to build the target.
+#  Usage: mk_test.py --decode [-v|-c|-q] [-s srcdir]... [logfile]
+TOKEN_SYNC = 0xa5
+TOKEN_TEST, TOKEN_RESULT, TOKEN_FAIL, TOKEN_STRING, TOKEN_DIAG, TOKEN_SUMMARY, TOKEN_SLOW, TOKEN_TIME, TOKEN_PROPERTY, TOKEN_STATS, \
+  TOKEN_ALLOCS, TOKEN_STACK, TOKEN_BENCH, TOKEN_CASE = range(1, 15)
+TOKEN_STAT_TIME, TOKEN_STAT_CPU, TOKEN_STAT_ALLOC, TOKEN_STAT_STACK = 1, 2, 4, 8
+TOKEN_FMT_TEXT, TOKEN_FMT_FAIL, TOKEN_FMT_ASSERT, TOKEN_FMT_ASSERT_INT, TOKEN_FMT_ASSERT_HEX, TOKEN_FMT_ASSERT_STR = range(6)
+TINY_TEST_SUCCESS = 0
+
+def token_file_id(name):
+	'Must match tt_token_file_id() in tinytest.c.'
+	h = 0x811c9dc5
+	for c in name.encode():
+		h = ((h ^ c) * 0x01000193) & 0xffffffff
+	return (h ^ (h >> 16)) & 0xffff
+
+def macro_args(line, macros):
+	'Find the first of the macros invoked on a line and return a list of its arguments as text, or None.'
+	for macro in macros:
+		m = re.search(r'\b%s\s*\(' % macro, line)
+		if not m:
+			continue
+		args, depth, quote, arg = [], 1, None, ''
+		i = m.end()
+		while i < len(line) and depth > 0:
+			c = line[i]
+			if quote:
+				if c == '\\':
+					arg += c
+					i += 1
+					c = line[i] if i < len(line) else ''
+				elif c == quote:
+					quote = None
+			elif c in '"\'':
+				quote = c
+			elif c == '(':
+				depth += 1
+			elif c == ')':
+				depth -= 1
+				if depth == 0:
+					break
+			elif c == ',' and depth == 1:
+				args.append(arg.strip())
+				arg = ''
+				i += 1
+				continue
+			arg += c
+			i += 1
+		args.append(arg.strip())
+		return args
+	return None
+
+def unquote(text):
+	'Return the value of a C string literal, or the text unchanged if it is not a literal.'
+	parts = re.findall(r'"((?:[^"\\]|\\.)*)"', text)
+	if not parts:
+		return text
+	return ''.join(parts).encode().decode('unicode_escape')
+
+def c_format(fmt, args):
+	'Format integer arguments with a printf format string.'
+	args = list(args)
+	def conv(m):
+		flags, width, spec = m.group(1), m.group(2), m.group(4)
+		if spec == '%':
+			return '%'
+		v = args.pop(0) if args else 0
+		if spec == 'd':
+			v = v - (1 << 32) if v & 0x80000000 else v
+		elif spec in 'sP':
+			return '<string>'
+		elif spec == 'c':
+			return chr(v & 0xff)
+		return ('%' + flags + width + {'d': 'd', 'u': 'd', 'x': 'x', 'X': 'X'}[spec]) % v
+	return re.sub(r'%(-?0?)(\d*)(l*)([duxXscP%])', conv, fmt)
+
+class TokenSource:
+	'Source files indexed by the file ID that the target sends.'
+	def __init__(self, srcdirs):
+		self.files = {}
+		for srcdir in srcdirs:
+			for path in sorted(glob.glob(os.path.join(srcdir, '*.c')) + glob.glob(os.path.join(srcdir, '*.cpp'))):
+				lines = open(path).read().splitlines()
+				names = [os.path.relpath(path) if srcdir == '.' else path, os.path.basename(path)]
+				for ln in lines:
+					m = re.search(r'TT_DECLARE_MODULE\s*\(\s*"([^"]*)"', ln)
+					if m:
+						names.append(m.group(1))
+				for name in names:
+					self.files.setdefault(token_file_id(name), (name, lines))
+	def name(self, file_id):
+		return self.files.get(file_id, ('<file %04x>' % file_id, None))[0]
+	def line(self, file_id, lineno):
+		lines = self.files.get(file_id, (None, []))[1] or []
+		return lines[lineno-1] if 0 < lineno <= len(lines) else ''
+	def describe(self, file_id, lineno, case=None):
+		'Recover a test description from the line that ran it, or the test function definition, & the index of a case of a table.'
+		ln = self.line(file_id, lineno)
+		args = macro_args(ln, ['TT_TEST_SIMPLE', 'TT_BENCH_SIMPLE', 'TT_TEST'])
+		if args:
+			return '%s()' % args[0]
+		args = macro_args(ln, ['TT_TEST_CASE'])
+		if args:
+			return '%s(%s)' % (args[0], ','.join(args[1:]))
+		if case is not None:	# A table written by hand, the line is its initialiser, which starts with the name.
+			m = re.search(r'"((?:[^"\\]|\\.)*)"', ln)
+			return '%s[%d]' % (unquote(m.group(0)) if m else '?', case)
+		args = macro_args(ln, ['ttRunTest', 'ttRunBench'])
+		if args and len(args) == 4:
+			return unquote(args[3])
+		m = reTestFunction.search(ln) or reBenchFunction.search(ln)
+		if m:
+			return '%s()' % m.group(1)
+		return '?'
+
+def decode(argv):
+	import argparse
+	parser = argparse.ArgumentParser(prog='mk_test.py --decode', description='Decode tokenized Tinytest output.')
+	parser.add_argument('-v', dest='mode', action='store_const', const='verbose', default='default', help='verbose output')
+	parser.add_argument('-c', dest='mode', action='store_const', const='concise', help='concise output')
+	parser.add_argument('-q', dest='mode', action='store_const', const='quiet', help='no output')
+	parser.add_argument('-s', dest='srcdirs', action='append', default=['.'], help='directory with source files')
+	parser.add_argument('logfile', nargs='?', help='file with output from target, default stdin')
+	opts = parser.parse_args(argv)
+	src = TokenSource(opts.srcdirs)
+	stream = open(opts.logfile, 'rb') if opts.logfile else sys.stdin.buffer
+	out = sys.stdout
+	verbose, concise = opts.mode == 'verbose', opts.mode == 'concise'
+	test = (0, 0, None)		# File ID, line & case index of the test that is running.
+	fails = 0
+	slowest, times = False, None
+
+	def byte():
+		b = stream.read(1)
+		if not b:
+			raise EOFError
+		return b[0]
+	def word():
+		return byte() | (byte() << 8)
+	def long_word():
+		return word() | (word() << 16)
+	def quad_word():
+		return long_word() | (long_word() << 32)
+	def thousandths(v):
+		return '%d.%03d' % (v // 1000, v % 1000)
+	def milli(us):
+		return thousandths(us) + 'ms'
+	def string():
+		if byte() != TOKEN_SYNC or byte() != TOKEN_STRING:
+			return '?'
+		chars = bytearray()
+		while True:
+			c = byte()
+			if c == 0:
+				return chars.decode(errors='replace')
+			chars.append(c)
+
+	try:
+		while True:
+			c = byte()
+			if c != TOKEN_SYNC:
+				if opts.mode != 'quiet':
+					out.write(chr(c))
+				continue
+			rtype = byte()
+			if rtype == TOKEN_TEST:
+				test = (word(), word(), None)
+				if verbose:
+					out.write('%s:%d: ' % (src.name(test[0]), test[1]))
+			elif rtype == TOKEN_CASE:
+				test = test[:2] + (word(),)
+			elif rtype == TOKEN_RESULT:
+				result = byte()
+				if verbose:
+					out.write('[%s]: %s\n' % (src.describe(*test), 'OK' if result == TINY_TEST_SUCCESS else 'IGNORED'))
+				elif concise:
+					out.write('.' if result == TINY_TEST_SUCCESS else 'I')
+			elif rtype == TOKEN_FAIL:
+				fmt, file_id, lineno, nargs = byte(), word(), word(), byte()
+				args = [long_word() for i in range(nargs)]
+				ln = src.line(file_id, lineno)
+				if fmt == TOKEN_FMT_TEXT:
+					msg = string()
+				elif fmt == TOKEN_FMT_FAIL:
+					msg = 'Failure: %s' % unquote((macro_args(ln, ['TT_FAIL']) or ['?'])[0])
+				elif fmt == TOKEN_FMT_ASSERT:
+					msg = "Expected `%s' to be true" % (macro_args(ln, ['TT_ASSERT']) or ['?'])[0]
+				elif fmt in (TOKEN_FMT_ASSERT_INT, TOKEN_FMT_ASSERT_HEX):
+					margs = macro_args(ln, ['TT_ASSERT_INT_HEX', 'TT_ASSERT_INT']) or (macro_args(ln, ['TT_ASSERT_GENERIC']) or ['?'] * 3)[2:]
+					if fmt == TOKEN_FMT_ASSERT_INT:
+						vfmt = '%d'
+					else:	# The target sends the field width of its TT_FMT_HEX.
+						width = args[2] if len(args) > 2 else 8
+						vfmt = '0x%%0%dx' % width
+						if 0 < width < 8:
+							args = [v & ((1 << (4 * width)) - 1) for v in args]
+					msg = c_format("Expected `%s' == " + vfmt + ", got " + vfmt, [0] + args).replace('<string>', margs[0], 1)
+				elif fmt == TOKEN_FMT_ASSERT_STR:
+					margs = macro_args(ln, ['TT_ASSERT_STR']) or ['?', '?']
+					msg = "Expected `%s' == \"%s\", got \"%s\"" % (margs[0], unquote(margs[1]), string())
+				else:
+					msg = 'Unknown format %d' % fmt
+				fails += 1
+				if concise:
+					out.write('F')
+				elif opts.mode != 'quiet':
+					out.write('%s:%d: [%s:%d %s] FAIL: %s.\n' % (src.name(file_id), lineno, src.name(test[0]), test[1], src.describe(*test), msg))
+			elif rtype == TOKEN_STRING:	# Not expected here, skip it.
+				while byte() != 0:
+					pass
+			elif rtype == TOKEN_DIAG:
+				file_id, lineno, nargs = word(), word(), byte()
+				args = [long_word() for i in range(nargs)]
+				margs = macro_args(src.line(file_id, lineno), ['ttDiagnostic']) or ['"?"']
+				if verbose:
+					out.write('# %s\n' % c_format(unquote(margs[0]), args))
+			elif rtype == TOKEN_SLOW:
+				file_id, lineno, elapsed = word(), word(), long_word()
+				if opts.mode != 'quiet':
+					if not slowest:
+						out.write('------------------------------------------------\nSlowest tests:\n')
+					out.write('  %s %s:%d: %s\n' % (milli(elapsed), src.name(file_id), lineno, src.describe(file_id, lineno)))
+				slowest = True
+			elif rtype == TOKEN_PROPERTY:
+				iteration, seed, generated, shrunk = long_word(), long_word() | (long_word() << 32), long_word(), long_word()
+				if opts.mode not in ('quiet', 'concise'):
+					out.write("# Property failed at iteration %d with seed %d, rerun with `-S %d'. Input shrunk from %d to %d bytes.\n" % 
+					  (iteration, seed, seed, generated, shrunk))
+			elif rtype == TOKEN_STATS:
+				flags, stats = byte(), []
+				if flags & TOKEN_STAT_TIME:
+					stats.append('time %s' % milli(long_word()))
+				if flags & TOKEN_STAT_CPU:
+					stats.append('cpu %s' % milli(long_word()))
+				if flags & TOKEN_STAT_ALLOC:
+					stats.append('allocs %d, bytes %d, peak %d' % (long_word(), long_word(), long_word()))
+				if flags & TOKEN_STAT_STACK:
+					stats.append('stack %d' % long_word())
+				if verbose:
+					out.write('[%s]: %s\n' % (src.describe(*test), ', '.join(stats)))
+			elif rtype == TOKEN_ALLOCS:
+				file_id, lineno, allocs, nbytes, peak = word(), word(), long_word(), long_word(), long_word()
+				if opts.mode not in ('quiet', 'concise'):
+					out.write('------------------------------------------------\n')
+					out.write('Allocations %d, bytes %d, highest peak %d bytes in %s:%d: %s\n' % 
+					  (allocs, nbytes, peak, src.name(file_id), lineno, src.describe(file_id, lineno)))
+			elif rtype == TOKEN_STACK:
+				file_id, lineno, nbytes = word(), word(), long_word()
+				if opts.mode not in ('quiet', 'concise'):
+					out.write('------------------------------------------------\n')
+					out.write('Deepest stack %d bytes in %s:%d: %s\n' % (nbytes, src.name(file_id), lineno, src.describe(file_id, lineno)))
+			elif rtype == TOKEN_BENCH:
+				file_id, lineno, median, minimum, mad = word(), word(), quad_word(), quad_word(), quad_word()
+				iterations, samples, baseline = long_word(), word(), quad_word()
+				if opts.mode != 'quiet':
+					out.write('%s:%d: [%s]: %sns/op median, min %s, MAD %s, %d iterations x %d samples%s\n' % (src.name(file_id), lineno, 
+					  src.describe(file_id, lineno), thousandths(median), thousandths(minimum), thousandths(mad), iterations, samples, 
+					  ', baseline %s' % thousandths(baseline) if baseline else ''))
+			elif rtype == TOKEN_TIME:
+				times = (milli(long_word()), milli(long_word()))
+			elif rtype == TOKEN_SUMMARY:
+				npass, nfail, nignore, ntimeout = word(), word(), word(), word()
+				if opts.mode != 'quiet':
+					out.write('------------------------------------------------\n')
+					out.write('Passed %d, failed %d, ignored %d%s.\n' % (npass, nfail, nignore, ', timed out %d' % ntimeout if ntimeout else ''))
+					if times:
+						out.write('Total time %s, in tests %s.\n' % times)
+					out.write('%s\n' % ('FAIL' if nfail + ntimeout > 0 else 'OK'))
+				out.flush()
+				return 1 if nfail + ntimeout > 0 else 0
+			else:
+				out.write('<unknown record %d>' % rtype)
+			out.flush()
+	except EOFError:
+		pass
+	return 1 if fails > 0 else 0
 	
+# Merge the results files written with `-o' by shards of a test run, see ttSetShard() in tinytest.h. Prints the failures & a summary, 
+# & returns 1 if any test failed or timed out, like ttFinish(), or 2 if a file cannot be read, like ttMain(). The verdict is from the
+# counts in the `end' line that ttFinish() writes, & there must be one for each shard, so a shard that crashed or never ran fails.
+RESULTS_FILE_VERSION = 1
+def merge(argv):
+	import argparse
+	parser = argparse.ArgumentParser(prog='mk_test.py --merge', description='Merge Tinytest results files from shards of a run.')
+	parser.add_argument('-q', dest='quiet', action='store_true', help='no output')
+	parser.add_argument('-o', dest='output', help='write the merged results file')
+	parser.add_argument('results', nargs='+', help='results files from the shards')
+	opts = parser.parse_args(argv)
+	lines = []
+	ends = {}		# Counts from the end line of each shard, by shard number.
+	nshards = None
+	for fn in opts.results:
+		try:
+			with open(fn) as f:
+				header = f.readline().rstrip('\r\n').split('\t')
+				if header != ['tinytest-results', str(RESULTS_FILE_VERSION)]:
+					sys.stderr.write("File `%s' is not a version %d results file.\n" % (fn, RESULTS_FILE_VERSION))
+					return 2
+				end = None
+				for ln in f:
+					fields = ln.rstrip('\r\n').split('\t')
+					if fields[0] == 'end':
+						end = fields
+					else:
+						lines.append('\t'.join(fields))
+		except OSError as e:
+			sys.stderr.write("Cannot read results file `%s': %s.\n" % (fn, e.strerror))
+			return 2
+		if not end or len(end) != 8 or end[1] != str(RESULTS_FILE_VERSION):
+			sys.stderr.write("File `%s' has no end line, the run did not finish.\n" % fn)
+			return 2
+		shard, shards = int(end[2]), int(end[3])
+		if nshards not in (None, shards) or shard in ends:
+			sys.stderr.write("File `%s' is shard %d of %d, which does not fit with the other files.\n" % (fn, shard, shards))
+			return 2
+		nshards = shards
+		ends[shard] = [int(n) for n in end[4:]]
+	missing = sorted(set(range(1, nshards + 1)) - set(ends))
+	if missing:
+		sys.stderr.write("No results file for shard%s %s of %d.\n" % ('s' if len(missing) > 1 else '', ', '.join(map(str, missing)), nshards))
+		return 2
+	counts = dict(zip(('pass', 'fail', 'ignore', 'timeout'), (sum(n) for n in zip(*ends.values()))))
+	for ln in lines:
+		fields = ln.split('\t')
+		if fields[0] == 'test' and len(fields) == 6 and fields[3] in ('fail', 'timeout') and not opts.quiet:
+			print('%s: %s %s' % (fields[1], fields[2], fields[3].upper()))
+	if opts.output:
+		with open(opts.output, 'w') as f:
+			f.write('tinytest-results\t%d\n' % RESULTS_FILE_VERSION)
+			f.write(''.join(ln + '\n' for ln in lines))
+			f.write('end\t%d\t1\t1\t%d\t%d\t%d\t%d\n' % (RESULTS_FILE_VERSION, counts['pass'], counts['fail'], counts['ignore'], counts['timeout']))
+	failed = counts['fail'] + counts['timeout'] > 0
+	if not opts.quiet:
+		print('------------------------------------------------')
+		print('Passed %d, failed %d, ignored %d%s.' % (counts['pass'], counts['fail'], counts['ignore'], 
+		  ', timed out %d' % counts['timeout'] if counts['timeout'] else ''))
+		print('FAIL' if failed else 'OK')
+	return 1 if failed else 0
+
+# Select the tests affected by a change from the coverage of each test, written with `-C dir', see ttCaptureCoverage() in tinytest.h.
+# The changed lines are read from a unified diff, e.g. from `git diff -U0', or from lines like `file:line'. Lines of the old file are 
+# used, as the coverage is from before the change. The selected tests are written in the format of the last failed file, so they are
+# run by the `-L' option. The map from lines to tests is cached in `dir/map.json'.
+COVERAGE_MAP_VERSION = 1
+LAST_FAILED_FILE_VERSION = 1
+def coverage_lines(test_dir, binary):
+	'Return {source path: set(line)} of the lines run by a test, from gcov data files or llvm-cov profiles.'
+	import subprocess
+	lines = {}
+	gcdas = glob.glob(os.path.join(test_dir, '**', '*.gcda'), recursive=True)
+	for gcda in gcdas:		# The data file is under the directory, at the path of the object, where its notes file is.
+		gcno = os.path.splitext(gcda)[0] + '.gcno'
+		if not os.path.exists(gcno):
+			os.symlink(os.sep + os.path.relpath(gcno, test_dir), gcno)
+	if gcdas:
+		out = subprocess.run(['gcov', '--stdout', '--json-format'] + gcdas, capture_output=True, text=True).stdout
+		for doc in out.splitlines():
+			doc = json.loads(doc)
+			for f in doc['files']:
+				path = os.path.normpath(os.path.join(doc.get('current_working_directory', ''), f['file']))
+				lines.setdefault(path, set()).update(ln['line_number'] for ln in f['lines'] if ln['count'] > 0)
+	profraws = glob.glob(os.path.join(test_dir, '*.profraw'))
+	if profraws:
+		if not binary:
+			error('Option -b is needed for llvm-cov profiles.')
+		profdata = os.path.join(test_dir, 'test.profdata')
+		subprocess.run(['llvm-profdata', 'merge', '-sparse', '-o', profdata] + profraws, check=True)
+		out = subprocess.run(['llvm-cov', 'export', '-format=lcov', '-instr-profile=' + profdata, binary], capture_output=True, 
+		  text=True).stdout
+		for ln in out.splitlines():
+			if ln.startswith('SF:'):
+				path = lines.setdefault(os.path.normpath(ln[3:]), set())
+			elif ln.startswith('DA:'):
+				lineno, count = ln[3:].split(',')[:2]
+				if int(count) > 0:
+					path.add(int(lineno))
+	return lines
+
+def coverage_map(covdir, binary):
+	'Return the tests as {name: (filename, line, description)} & the map {source path: {line: [test names]}}.'
+	index = os.path.join(covdir, 'tests')
+	map_file = os.path.join(covdir, 'map.json')
+	try:
+		with open(map_file) as f:
+			cached = json.load(f)
+		if cached.get('version') == COVERAGE_MAP_VERSION and os.path.getmtime(map_file) >= os.path.getmtime(index):
+			return dict((name, tuple(test)) for name, test in cached['tests'].items()), cached['map']
+	except (OSError, ValueError):
+		pass
+	tests, cov = {}, {}
+	try:
+		with open(index) as f:
+			for ln in f:
+				fields = ln.rstrip('\r\n').split('\t')
+				if len(fields) == 4:
+					tests[fields[0]] = (fields[1], int(fields[2]), fields[3])
+	except OSError as e:
+		error("Cannot read coverage index `%s': %s." % (index, e.strerror))
+	for name in tests:
+		for path, lines in coverage_lines(os.path.join(covdir, name), binary).items():
+			for lineno in lines:
+				cov.setdefault(path, {}).setdefault(str(lineno), []).append(name)
+	with open(map_file, 'w') as f:
+		json.dump({'version': COVERAGE_MAP_VERSION, 'tests': tests, 'map': cov}, f)
+	return tests, cov
+
+def changed_lines(stream):
+	'Return {path: set(line)} of the lines changed by a unified diff, in the old file, or from lines like `file:line\'.'
+	changed = {}
+	path = None
+	for ln in stream:
+		m = re.match(r'--- (?:a/)?(\S+)', ln)
+		if m:
+			path = m.group(1)
+			continue
+		m = re.match(r'@@ -(\d+)(?:,(\d+))? ', ln)
+		if m and path:
+			start, count = int(m.group(1)), int(m.group(2) or '1')
+			changed.setdefault(path, set()).update(range(start, start + max(count, 1)))	# An insertion is next to its line.
+			continue
+		m = re.match(r'(\S+):(\d+)\s*$', ln)
+		if m:
+			changed.setdefault(m.group(1), set()).add(int(m.group(2)))
+	return changed
+
+def impact(argv):
+	import argparse
+	parser = argparse.ArgumentParser(prog='mk_test.py --impact', description='Select the Tinytest tests that cover changed lines.')
+	parser.add_argument('-C', dest='covdir', required=True, help='directory written by the tests with -C')
+	parser.add_argument('-b', dest='binary', help='test binary, for llvm-cov profiles')
+	parser.add_argument('-o', dest='output', help='write the selected tests to this file, e.g. .tinytest-failed, default stdout')
+	parser.add_argument('diff', nargs='?', help='file with a diff or lines like file:line, default stdin')
+	opts = parser.parse_args(argv)
+	tests, cov = coverage_map(opts.covdir, opts.binary)
+	with (open(opts.diff) if opts.diff else sys.stdin) as f:
+		changed = changed_lines(f)
+	selected = set()
+	for path, lines in cov.items():
+		for diff_path, diff_lines in changed.items():		# Paths in a diff are relative to the top of the tree.
+			if path == diff_path or path.endswith(os.sep + os.path.normpath(diff_path)):
+				selected.update(name for lineno in diff_lines for name in lines.get(str(lineno), ()))
+	keys = sorted(set(tests[name] for name in selected))
+	sys.stderr.write('Selected %d of %d tests.\n' % (len(keys), len(set(tests.values()))))
+	out = open(opts.output, 'w') if opts.output else sys.stdout
+	out.write('tinytest-failed\t%d\n' % LAST_FAILED_FILE_VERSION)
+	out.write(''.join('%s\t%d\t%s\n' % key for key in keys))
+	return 0
+
 TEST_PATTERN = 'test*.c'
-files = glob.glob(TEST_PATTERN)
-test_funcs = {}
-test_decls, test_run, test_stubs, fixture_decls = [], [], [], []
-stubnum = 0
-extra_includes = []
-'''
-filename_strs = []
+OUTPUT_FILE = 'mk_test.autogen.h'
+UNIT_FILE = 'mk_test_%s.autogen.c'	# With --units, the code for each test file, which is compiled & linked with the runner.
+UNITS_LIST_FILE = 'mk_test.autogen.mk'	# With --units, a makefile fragment that lists the units as MK_TEST_UNITS.
+test_settings = {}		# Calls made before each run of a test function, from TT_TIMEOUT() & TT_SERIAL().
+
+def start_unit():
+	'Start the generated code, for all the files, or for one file with --units.'
+	global test_funcs, bench_funcs, test_run, test_tables, fixture_decls, table_funcs, tablenum, extra_includes, filename_strs
+	test_funcs = {}
+	bench_funcs = {}
+	test_run, test_tables, fixture_decls = [], [], []
+	table_funcs = []		# Parameterised test functions with a case type, runner & describer.
+	tablenum = 0
+	extra_includes = []
+	filename_strs = {}		# Index of each filename, in order of first use.
 def get_fn_str(fn):
-	global filename_strs
-	if fn not in filename_strs:
-		filename_strs.append(fn)
-	return 'FN_%04d' % filename_strs.index(fn)
-'''
-sys.stderr.write("Scanning for files matching '%s'.\n" % TEST_PATTERN)
-for fn in files: # Iterate over all files matching glob pattern.
-	module = fn # os.path.basename(fn) # Form module name.
-	fixture = None
-	dumper = None
-	num_tests = 0
-	tt_module_name = None
-	for lno in enumerate(open(fn).read().splitlines(), 1): # Iterate over all lines.
-		lineno, ln = lno
-		m = reTtMacros.search(ln)
-		if m:
-			macro, args = m.groups()
-			args = args.strip()
-			if args.startswith('('): args = args[1:]
-			if args.endswith(')'): args = args[:-1]
-			args = [x.strip() for x in args.split(',')]
-			if macro == 'TT_IGNORE_FILE':	# Ignore the rest of this file.
-				sys.stderr.write(" Ignoring file.\n")
-				break
-			elif macro == 'TT_BEGIN_FIXTURE':
-				if len(args) != 2:
-					error("Macro %s, %s, line %d requires 2 arguments." % (macro, module, lineno))
-				fixture = tuple(args)
-				test_run.append('tt_register_fixture(%s, %s);' % fixture)
-				for funcname in fixture:
-					if funcname != "NULL":
-						fixture_decls.append('void %s(void);\n' % funcname)
-			elif macro == 'TT_DUMP_FUNC':
-				if len(args) != 1:
-					error("Macro %s, %s, line %d requires 1 argument." % (macro, module, lineno))
-				dumper = args[0]
-				test_run.append('tinytest_set_dump(%s);' % dumper)
-				if dumper != "NULL":
-					fixture_decls.append('void %s(void);\n' % dumper)
-			elif macro == 'TT_END_FIXTURE':
-				test_run.append('tt_register_fixture(NULL, NULL);')
-				fixture = None
-			elif macro == 'TT_TEST_CASE': 
-				# This is tricky as we might get a line like: TT_TEST_CASE(testCall, "foo", "{\"a3\"=1}", -3)
-
-				# TODO: This breaks with a line like 'TT_TEST_CASE(testNumber, "1./,'5...", 0, 15)' with a comma in a string.
-				test_func = args.pop(0)
-				if test_func not in test_funcs:
-					error("Macro %s, %s, line %d references an unknown test function `%s`." % (macro, module, lineno, test_func))
-				test_stub_name = '%s_stub_%04d' % (test_func, stubnum)
-				stubnum += 1
-				test_stub_body = '%s(%s)' % (test_func, ','.join(args))
-				descr =	 test_stub_body.replace(r'\"', r'\\\^').replace('"', r'\"').replace(r'\\\^', r'\\\"')
-				if tt_module_name is None:
-					error("Expected to have read a module name")
-				test_run.append('tinytest_run_test(%s, %s, %d, "%s");' % (test_stub_name, get_fn_str(fn), lineno, descr))
-				test_stubs.append('static void %s(void) { %s; }\n' % (test_stub_name, test_stub_body))
+	return 'FN_%04d' % filename_strs.setdefault(fn, len(filename_strs))
+
+def param_types(test_func, test_args):
+	'List the types of the parameters of a test function, the script only understands simple declarations like `const char* s\'.'
+	types = []
+	for param in test_args.split(','):
+		param = param.strip()
+		if '[' in param or '(' in param or param == '...':
+			error("Test function %s has a parameter `%s' that cannot be in a table of test cases." % (test_func, param))
+		m = re.match(r'(.*[\s*])\w+$', param)
+		types.append(' '.join((m.group(1) if m else param).replace('*', ' * ').split()).replace(' *', '*'))
+	return types
+
+def describe_code(test_func, types):
+	'Code to print a case as `testFoo(1, "a")\', the arguments are the fields a0, a1... of the case c.'
+	code, fmt, args = [], test_func + '(', []
+	def flush():
+		if fmt:
+			code.append('tt_printf(TT_PSTR("%s")%s);' % (fmt, ''.join(', ' + a for a in args)))
+		return '', []
+	for n, t in enumerate(types):
+		field, words = 'c.a%d' % n, re.findall(r'\w+', t)
+		if n > 0:
+			fmt += ', '
+		if '*' in t and 'char' in words and t.count('*') == 1:
+			fmt += '\\"%s\\"'
+			args.append(field)
+		elif '*' in t:
+			fmt += '0x%lx'
+			args.append('(unsigned long)(size_t)' + field)
+		elif 'float' in words or 'double' in words:
+			fmt, args = flush()
+			code.append('tt_print_double(%s);' % field)
+		elif 'unsigned' in words or 'bool' in words or '_Bool' in words or re.match(r'u(int\w*|char|short|long)$|size_t$', words[-1]):
+			fmt += '%lu'
+			args.append('(unsigned long)' + field)
+		elif set(words) & set(['int', 'long', 'short', 'char', 'signed']) or re.match(r'(int\d+_t|ssize_t|ptrdiff_t|intptr_t)$', words[-1]):
+			fmt += '%ld'
+			args.append('(long)' + field)
+		else:					# Maybe a struct, so don't try.
+			fmt += '?'
+	fmt += ')'
+	flush()
+	return code
+
+def add_table_func(test_func):
+	'Declare the case type, runner & describer for a parameterised test function.'
+	types = param_types(test_func, test_funcs[test_func])
+	read = '\t%s_case_t c;\n\ttt_pgm_read_mem(&c, (const %s_case_t*)table->cases + index, sizeof(c));\n' % (test_func, test_func)
+	test_tables.append('typedef struct { int tt_line; %s } %s_case_t;\n' % (' '.join('%s a%d;' % (t, n) for n, t in enumerate(types)), test_func))
+	test_tables.append('static const char %s_name[] TT_ATTR_PGM = "%s()";\n' % (test_func, test_func))
+	test_tables.append('static void %s_run(const tt_test_table_t* table, unsigned index) {\n%s\t%s(%s);\n}\n' % 
+	  (test_func, read, test_func, ', '.join('c.a%d' % n for n in range(len(types)))))
+	test_tables.append('static void %s_describe(const tt_test_table_t* table, unsigned index) {\n%s%s}\n' % 
+	  (test_func, read, ''.join('\t%s\n' % x for x in describe_code(test_func, types))))
+	table_funcs.append(test_func)
+
+def end_table(table):
+	'Declare a table of cases of a test function that are run together.'
+	if table:
+		test_func, num, cases = table
+		test_tables.append('static const %s_case_t %s_cases_%04d[] TT_ATTR_PGM = {\n%s};\n' % 
+		  (test_func, test_func, num, ''.join('\t{ %d, %s },\n' % (lineno, ', '.join(args)) for lineno, args in cases)))
+		test_tables.append('static const tt_test_table_t %s_table_%04d = { %s_name, %s_cases_%04d, sizeof(%s_case_t), %d, 0, %s_run, %s_describe, NULL };\n' % 
+		  (test_func, num, test_func, test_func, num, test_func, len(cases), test_func, test_func))
+
+def register_fixture(fixture, dumper):
+	setup, teardown = fixture or ('NULL', 'NULL')
+	return 'ttRegisterFixture(%s, %s, %s);' % (setup, dumper or 'NULL', teardown)
+# Scanning is the slow part, so the lines of interest in each file are cached in CACHE_FILE, keyed by the file's mtime & size, & 
+# its content hash in case it was touched but not changed. Changed files are scanned in parallel if there are enough of them.
+CACHE_FILE = '.mk_test.cache'
+CACHE_VERSION = 1			# Change if the scanning changes.
+PARALLEL_SCAN_MIN = 16		# Fewer changed files than this are scanned here, as starting workers is not free.
+
+def scan_file(job):
+	'Return the hash of a file & its lines that the generator uses, as (line number, text), or None for the lines if the hash is old_hash.'
+	fn, old_hash, st = job
+	with open(fn, 'rb') as f:
+		data = f.read()
+	digest = hashlib.sha1(data).hexdigest()
+	if digest == old_hash:
+		return digest, None
+	return digest, [(lineno, ln) for lineno, ln in enumerate(data.decode(errors='replace').splitlines(), 1)
+	  if reTtMacros.search(ln) or reTestFunction.search(ln) or reBenchFunction.search(ln)]
+
+def scan_files(files):
+	'Return a dict of the lines of interest in each file, only scanning files that are not in the cache.'
+	try:
+		with open(CACHE_FILE) as f:
+			cache = json.load(f)
+		if cache.get('version') != CACHE_VERSION:
+			cache = {}
+	except (OSError, ValueError):
+		cache = {}
+	old, new = cache.get('files', {}), {}
+	todo = []
+	for fn in files:
+		st = os.stat(fn)
+		entry = old.get(fn)
+		if entry and entry['mtime'] == st.st_mtime_ns and entry['size'] == st.st_size:
+			new[fn] = entry
+		else:
+			todo.append((fn, entry and entry['hash'], st))	# The stat from before the read, so an edit during the scan is seen next time.
+	if len(todo) >= PARALLEL_SCAN_MIN:
+		import concurrent.futures
+		with concurrent.futures.ProcessPoolExecutor() as pool:
+			results = list(pool.map(scan_file, todo, chunksize=max(1, len(todo) // (4 * (os.cpu_count() or 1)))))
+	else:
+		results = [scan_file(job) for job in todo]
+	for (fn, old_hash, st), (digest, lines) in zip(todo, results):
+		new[fn] = { 'mtime': st.st_mtime_ns, 'size': st.st_size, 'hash': digest, 'lines': old[fn]['lines'] if lines is None else lines }
+	if todo or set(old) != set(new):
+		tmp = CACHE_FILE + '.tmp'
+		with open(tmp, 'w') as f:
+			json.dump({ 'version': CACHE_VERSION, 'files': new }, f)
+		os.replace(tmp, CACHE_FILE)
+	sys.stderr.write("Scanned %d of %d files.\n" % (sum(lines is not None for digest, lines in results), len(files)))
+	return dict((fn, new[fn]['lines']) for fn in files)
+
+def write_if_changed(fn, text, report=True):
+	'Write the file only if its content changes, so that make does not rebuild things that depend on it for nothing.'
+	try:
+		with open(fn) as f:
+			if f.read() == text:
+				if report:
+					sys.stderr.write("%s is unchanged.\n" % fn)
+				return False
+	except OSError:
+		pass
+	with open(fn, 'w') as f:
+		f.write(text)
+	return True
+
+def unit_name(fn):
+	'Name of the unit for a test file, which is a C identifier.'
+	return re.sub(r'\W', '_', os.path.splitext(fn)[0])
+
+def generate(files, units):
+	global tablenum
+	sys.stderr.write("Scanning for files matching '%s'.\n" % TEST_PATTERN)
+	names = [unit_name(fn) for fn in files]
+	if units and len(set(names)) != len(names):
+		error('Test files %s have the same unit name.' % ', '.join(fn for fn in files if names.count(unit_name(fn)) > 1))
+	scanned = scan_files(files)
+	start_unit()
+	units_written = 0
+	for fn in files: # Iterate over all files matching glob pattern.
+		module = fn # os.path.basename(fn) # Form module name.
+		fixture = None
+		dumper = None
+		num_tests = 0
+		num_benches = 0
+		settings = []
+		suite = ()
+		table = None		# Consecutive cases of a test function, (function, number, [(line, args)...]).
+		for lineno, ln in scanned[fn]: # Iterate over all lines of interest.
+			m = reTtMacros.search(ln)
+			if m:
+				macro, args = m.groups()
+				args = args.strip()
+				if args.startswith('('): args = args[1:]
+				if args.endswith(')'): args = args[:-1]
+				args = [x.strip() for x in args.split(',')]
+				if macro == 'TT_IGNORE_FILE':	# Ignore the rest of this file.
+					sys.stderr.write(" Ignoring file.\n")
+					break
+				elif macro == 'TT_BEGIN_FIXTURE':
+					if len(args) not in (2, 4):
+						error("Macro %s, %s, line %d requires 2 or 4 arguments." % (macro, module, lineno))
+					fixture = tuple(args[:2])
+					test_run.append(register_fixture(fixture, dumper))
+					if suite:
+						test_run.append('ttEndSuite();')
+					suite = tuple(args[2:])
+					if suite:		# Suite setup & teardown, called once for the block.
+						test_run.append('ttBeginSuite(%s, %s);' % suite)
+					for funcname in args:
+						if funcname != "NULL":
+							fixture_decls.append('void %s(void);\n' % funcname)
+				elif macro == 'TT_DUMP_FUNC':
+					if len(args) != 1:
+						error("Macro %s, %s, line %d requires 1 argument." % (macro, module, lineno))
+					dumper = args[0]
+					test_run.append(register_fixture(fixture, dumper))
+					if dumper != "NULL":
+						fixture_decls.append('void %s(void);\n' % dumper)
+				elif macro == 'TT_END_FIXTURE':
+					fixture = None
+					test_run.append(register_fixture(fixture, dumper))
+					if suite:
+						test_run.append('ttEndSuite();')
+					suite = ()
+				elif macro == 'TT_TEST_CASE': 
+					# Cases are added to a table, consecutive cases of the same function share a table. 
+					args = macro_args(ln, [macro])		# We might get a line like: TT_TEST_CASE(testCall, "foo, bar", -3)
+					test_func = args.pop(0)
+					if test_func not in test_funcs:
+						error("Macro %s, %s, line %d references an unknown test function `%s`." % (macro, module, lineno, test_func))
+					if len(args) != len(param_types(test_func, test_funcs[test_func])):
+						error("Macro %s, %s, line %d has the wrong number of arguments for `%s`." % (macro, module, lineno, test_func))
+					if test_func not in table_funcs:
+						add_table_func(test_func)
+					if not (table and table[0] == test_func and test_run[-1] == table[3]):
+						end_table(table and table[:3])
+						tablenum += 1
+						test_run.extend(test_settings.get(test_func, []))
+						test_run.append('ttRunTestTable(&%s_table_%04d, %s);' % (test_func, tablenum, get_fn_str(fn)))
+						table = (test_func, tablenum, [], test_run[-1])
+					table[2].append((lineno, args))
+					num_tests += 1
+				elif macro == 'TT_TEST_VECTORS':
+					args = macro_args(ln, [macro])
+					if len(args) != 3:
+						error("Macro %s, %s, line %d requires 3 arguments." % (macro, module, lineno))
+					if args[0] not in test_funcs:
+						error("Macro %s, %s, line %d references an unknown test function `%s`." % (macro, module, lineno, args[0]))
+					test_run.extend(test_settings.get(args[0], []))
+					test_run.append('ttRunTestVectors(%s, %s, %s, %s, %d, "%s()");' % (args[0], args[1], args[2], get_fn_str(fn), lineno, args[0]))
+					num_tests += 1
+				elif macro == 'TT_INCLUDE_EXTRA':
+					extra_includes.append(args[0])
+				elif macro == 'TT_TIMEOUT':		# Applies to the next test function.
+					if len(args) != 1:
+						error("Macro %s, %s, line %d requires 1 argument." % (macro, module, lineno))
+					settings.append('ttSetNextTimeout(%s);' % args[0])
+				elif macro == 'TT_SERIAL':		# Applies to the next test function.
+					if args != ['']:
+						error("Macro %s, %s, line %d takes no arguments." % (macro, module, lineno))
+					settings.append('ttSetNextSerial();')
+				else:
+					print('***', macro, args, file=sys.stderr)
+			m = reTestFunction.search(ln)
+			if m:
+				test_func, test_args = m.groups()
+				if test_func in test_funcs:
+					error("Duplicate test function %s, %s, line %d." % (test_func, module, lineno))
+				if settings:
+					test_settings[test_func] = settings
+					settings = []
+				if test_args in ('', 'void'):
+					test_run.extend(test_settings.get(test_func, []))
+					test_run.append('ttRunTest(%s, %s, %d, "%s()");' % (test_func, get_fn_str(fn), lineno, test_func))
+				test_funcs[test_func] = test_args
 				num_tests += 1
-			elif macro == 'TT_INCLUDE_EXTRA':
-				extra_includes.append(args[0])
-			else:
-				print('***', macro, args, file=sys.stderr)
-		m = reTestFunction.search(ln)
-		if m:
-			test_func, test_args = m.groups()
-			if test_func in test_funcs:
-				error("Duplicate test function %s, %s, line %d." % (test_func, module, lineno))
-			if test_args in ('', 'void'):
-				test_run.append('tinytest_run_test(%s, %s, %d, "%s()");' % (test_func, get_fn_str(fn), lineno, test_func))
-			test_funcs[test_func] = test_args
-			num_tests += 1
-			
-	sys.stderr.write(" Found %d test%s in %s.\n" % (num_tests, 's'[:num_tests != 1], fn))
-	if fixture:
-		test_run.append('tt_register_fixture(NULL, NULL);')
-	if dumper:
-		test_run.append('tinytest_set_dump(NULL);')
+			m = reBenchFunction.search(ln)
+			if m:
+				bench_func, bench_args = m.groups()
+				if bench_func in bench_funcs:
+					error("Duplicate benchmark function %s, %s, line %d." % (bench_func, module, lineno))
+				test_run.append('ttRunBench(%s, %s, %d, "%s()");' % (bench_func, get_fn_str(fn), lineno, bench_func))
+				bench_funcs[bench_func] = bench_args
+				num_benches += 1
 			
-outfile = open('mk_test.autogen.h', 'wt')
-outfile.write("""\
+		end_table(table and table[:3])
+		sys.stderr.write(" Found %d test%s, %d benchmark%s in %s.\n" % (num_tests, 's'[:num_tests != 1], num_benches, 's'[:num_benches != 1], fn))
+		if fixture or dumper:
+			test_run.append('ttUnregisterFixture();')
+		if suite:
+			test_run.append('ttEndSuite();')
+		if units:
+			units_written += write_if_changed(UNIT_FILE % unit_name(fn), render('tt_run_' + unit_name(fn), '#include "tinytest.h"\n\n'), False)
+			start_unit()
+
+	if not units:
+		write_if_changed(OUTPUT_FILE, render('ttRunTests', ''))
+		return
+	# The runner only calls the units, so it only changes if the list of test files changes.
+	sys.stderr.write("Wrote %d of %d units.\n" % (units_written, len(files)))
+	for stale in set(glob.glob(UNIT_FILE % '*')) - set(UNIT_FILE % name for name in names):
+		os.remove(stale)
+	write_if_changed(OUTPUT_FILE, '/* This file is autogenerated -- do not edit. */\n\n/* Declare the functions in each unit. */\n' + 
+	  ''.join('void tt_run_%s(void);\n' % name for name in names) + '\n/* Call them. */\nvoid ttRunTests(void) {\n' + 
+	  ''.join('\ttt_run_%s();\n' % name for name in names) + '}\n\n')
+	write_if_changed(UNITS_LIST_FILE, '# This file is autogenerated -- do not edit.\nMK_TEST_UNITS =%s\n' % 
+	  ''.join(' \\\n\t' + UNIT_FILE % name for name in names))
+
+def render(run_func, prologue):
+	'Return the generated code, with the function that runs the tests.'
+	out = []
+	out.append("""\
 /* This file is autogenerated -- do not edit. */
 
 """)
-outfile.write("/* Extra include files. */\n")
-for exinc in extra_includes:
-	outfile.write('#include %s\n' % exinc)
-outfile.write('\n')
-outfile.write("/* Declare test functions. */\n")
-outfile.write(''.join(['void %s(%s);\n' % x for x in test_funcs.items()]))			 
-outfile.write('\n')
-
-outfile.write("/* Declare test stubs. */\n")
-outfile.write(''.join(test_stubs))			 
-outfile.write('\n')
-
-outfile.write("/* Declare fixture functions. */\n")
-outfile.write(''.join(fixture_decls))			
-outfile.write('\n')
-
-outfile.write("/* Declare filenames once. */\n")
-for n, fn in enumerate(filename_strs):
-	outfile.write('const char* FN_%04d = "%s";\n' % (n, fn))
-outfile.write('\n')
-
-outfile.write("/* Call our test functions. */\n")
-outfile.write("void runTests(void) {\n")
-outfile.write(''.join(['	%s\n' % x for x in test_run]))			 
-outfile.write("}\n")
-outfile.write('\n')
+	out.append(prologue)
+	out.append("/* Extra include files. */\n")
+	for exinc in extra_includes:
+		out.append('#include %s\n' % exinc)
+	out.append('\n')
+	out.append("/* Declare test functions. */\n")
+	out.append(''.join(['void %s(%s);\n' % x for x in test_funcs.items()]))			 
+	out.append('\n')
+
+	out.append("/* Declare benchmark functions. */\n")
+	out.append(''.join(['void %s(%s);\n' % x for x in bench_funcs.items()]))			 
+	out.append('\n')
+
+	out.append("/* Tables of test cases. */\n")
+	out.append(''.join(test_tables))			 
+	out.append('\n')
+
+	out.append("/* Declare fixture functions. */\n")
+	out.append(''.join(fixture_decls))			
+	out.append('\n')
+
+	out.append("/* Declare filenames once. */\n")
+	for n, fn in enumerate(filename_strs):
+		out.append('static const char FN_%04d[] TT_ATTR_PGM = "%s";\n' % (n, fn))
+	out.append('\n')
+
+	out.append("/* Call our test functions. */\n")
+	out.append("void %s(void) {\n" % run_func)
+	out.append(''.join(['	%s\n' % x for x in test_run]))			 
+	out.append("}\n")
+	out.append('\n')
+	return ''.join(out)
+
+# Usage: mk_test.py [--units]
+#  Without --units all the code is in OUTPUT_FILE, which is included by the file with main(). With --units each test file gets a 
+#  unit with its code, so editing one test file only rebuilds one small unit, & OUTPUT_FILE just calls them.
+if __name__ == '__main__':
+	if sys.argv[1:2] == ['--decode']:
+		sys.exit(decode(sys.argv[2:]))
+	if sys.argv[1:2] == ['--merge']:
+		sys.exit(merge(sys.argv[2:]))
+	if sys.argv[1:2] == ['--impact']:
+		sys.exit(impact(sys.argv[2:]))
+	if [arg for arg in sys.argv[1:] if arg != '--units']:
+		error('Usage: mk_test.py [--units] | --decode [options] | --merge [options] results... | --impact [options] [diff]')
+	generate(sorted(glob.glob(TEST_PATTERN)), '--units' in sys.argv[1:])
@@ -1,236 +1,3270 @@
 /* tinytest -- A very simple test harness for embedded systems.
 */
 
+// For pthread_getattr_np() with TT_STACK_PTHREAD, this must come before any system header.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <setjmp.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <limits.h>
 
 #include "tinytest.h"
 
+#if defined(TT_WANT_FORK) || defined(TT_WANT_FILES)
+#include <stdio.h>
+#endif
+#ifdef TT_WANT_FILES
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#ifdef TT_WANT_PERF
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#ifdef TT_WANT_FORK
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#endif
+#ifdef TT_WANT_THREADS
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+// The context of the running test is thread local if tests can run on a thread pool.
+#ifdef TT_WANT_THREADS
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+#define TT_THREAD_LOCAL _Thread_local
+#else
+#define TT_THREAD_LOCAL __thread
+#endif
+#else
+#define TT_THREAD_LOCAL
+#endif
+
+// Timing using the POSIX clock. Both clocks return microseconds. CPU time is for the thread if tests can run on a thread pool.
+#ifdef TT_CLOCK_POSIX
+#include <time.h>
+static tt_clock_t posix_clock(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (tt_clock_t)ts.tv_sec * 1000000UL + (tt_clock_t)(ts.tv_nsec / 1000);
+}
+#define tt_clock() posix_clock(CLOCK_MONOTONIC)
+#ifdef TT_WANT_THREADS
+#define tt_cpu_clock() posix_clock(CLOCK_THREAD_CPUTIME_ID)
+#else
+#define tt_cpu_clock() posix_clock(CLOCK_PROCESS_CPUTIME_ID)
+#endif
+#endif
+
+// Cycle counters for budget assertions. All return unsigned long, TT_CYCLES_MASK is the width of a counter that wraps.
+#ifdef TT_CYCLES_RDTSC
+static unsigned long rdtsc_cycles(void) {
+    unsigned lo, hi;
+    __asm__ __volatile__ ("lfence\n\trdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+    return ((unsigned long)hi << 16 << 16) | lo;
+}
+#define tt_cycles() rdtsc_cycles()
+#endif
+#ifdef TT_CYCLES_DWT
+// Cortex-M3 & later, enables the DWT cycle counter on first use.
+#define DWT_CTRL (*(volatile unsigned long*)0xe0001000UL)
+#define DWT_CYCCNT (*(volatile unsigned long*)0xe0001004UL)
+#define CM_DEMCR (*(volatile unsigned long*)0xe000edfcUL)
+static unsigned long dwt_cycles(void) {
+    if (0UL == (DWT_CTRL & 1UL)) {
+        CM_DEMCR |= 1UL << 24;          // TRCENA.
+        DWT_CYCCNT = 0UL;
+        DWT_CTRL |= 1UL;                // CYCCNTENA.
+    }
+    return DWT_CYCCNT;
+}
+#define tt_cycles() dwt_cycles()
+#endif
+#ifdef TT_CYCLES_POSIX
+#include <time.h>
+static unsigned long posix_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + (unsigned long)ts.tv_nsec;
+}
+#define tt_ns() posix_ns()
+#ifndef tt_cycles
+#define tt_cycles() posix_ns()          // Nanoseconds will do if there is no cycle counter.
+#endif
+#endif
+#ifndef TT_CYCLES_MASK
+#define TT_CYCLES_MASK (~0UL)
+#endif
+
+// Watchdog using a POSIX interval timer. The SIGALRM handler escapes from the test, it is not blocked while running so it can fire again.
+#ifdef TT_WATCHDOG_POSIX
+#include <signal.h>
+#include <sys/time.h>
+static void posix_watchdog_handler(int sig) {
+    (void)sig;
+    ttWatchdogExpired();
+}
+static void posix_watchdog(unsigned long ms) {
+    struct itimerval it;
+    memset(&it, 0, sizeof(it));
+    if (ms > 0) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = posix_watchdog_handler;
+        sa.sa_flags = SA_NODEFER;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGALRM, &sa, NULL);
+        it.it_value.tv_sec = (time_t)(ms / 1000);
+        it.it_value.tv_usec = (suseconds_t)((ms % 1000) * 1000);
+    }
+    setitimer(ITIMER_REAL, &it, NULL);
+}
+#define tt_watchdog_start(ms_) posix_watchdog(ms_)
+#define tt_watchdog_stop() posix_watchdog(0)
+#endif
+
+// Stack bounds of the current thread from the pthread library.
+#ifdef TT_STACK_PTHREAD
+#include <pthread.h>
+static void pthread_stack_bounds(char** lo, char** hi) {
+    pthread_attr_t attr;
+    void* addr = NULL;
+    size_t size = 0;
+    if (0 == pthread_getattr_np(pthread_self(), &attr)) {
+        pthread_attr_getstack(&attr, &addr, &size);
+        pthread_attr_destroy(&attr);
+    }
+    *lo = (char*)addr;
+    *hi = (char*)addr + size;
+}
+#define tt_stack_bounds(lo_, hi_) pthread_stack_bounds(&(lo_), &(hi_))
+#endif
+
+// Coverage with gcov, the counters are dumped under a prefix, e.g. `dir/path/to/object.gcda', & are not dumped again at exit.
+#ifdef TT_COVERAGE_GCOV
+void __gcov_reset(void);
+void __gcov_dump(void);
+static void gcov_coverage_dump(const char* dir) {
+    setenv("GCOV_PREFIX", dir, 1);
+    __gcov_dump();
+}
+#define tt_coverage_reset() __gcov_reset()
+#define tt_coverage_dump(dir_) gcov_coverage_dump(dir_)
+#endif
+
+/* Coverage with clang's source based coverage, the counters are written to `dir/<binary signature>.profraw'. Defining 
+	__llvm_profile_runtime stops the profile runtime writing the counters again at exit, over those of the last test. */
+#ifdef TT_COVERAGE_LLVM
+int __llvm_profile_runtime;
+void __llvm_profile_reset_counters(void);
+void __llvm_profile_set_filename(const char* name);
+int __llvm_profile_write_file(void);
+static void llvm_coverage_dump(const char* dir) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%%m.profraw", dir);
+    __llvm_profile_set_filename(path);
+    __llvm_profile_write_file();
+}
+#define tt_coverage_reset() __llvm_profile_reset_counters()
+#define tt_coverage_dump(dir_) llvm_coverage_dump(dir_)
+#endif
+
+// Stack measurement, the byte the free stack is painted with, the most bytes painted, and space left for the painting function.
+#ifndef TT_STACK_PAINT
+#define TT_STACK_PAINT 0xcd
+#endif
+#ifndef TT_STACK_PAINT_MAX
+#define TT_STACK_PAINT_MAX 0x10000UL
+#endif
+#ifndef TT_STACK_MARGIN
+#define TT_STACK_MARGIN 256
+#endif
+
+#ifdef __GNUC__
+#define TT_NOINLINE __attribute__((noinline))
+#else
+#define TT_NOINLINE
+#endif
+
+// Linux performance counters for each test, a counter that cannot be opened is just not reported.
+#ifdef TT_WANT_PERF
+typedef struct {
+    unsigned type;
+    unsigned long long config;
+    const char* name;
+} perf_event_def_t;
+static const perf_event_def_t PERF_EVENTS[] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache-misses" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch-misses" },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "page-faults" },
+};
+#define PERF_NUM_EVENTS ((int)(sizeof(PERF_EVENTS) / sizeof(PERF_EVENTS[0])))
+#endif
+
+// Maximum number of live blocks tracked for allocation tracking, further blocks are counted but not tracked.
+#ifndef TT_ALLOC_TRACK_MAX
+#define TT_ALLOC_TRACK_MAX 256
+#endif
+
+// Number of slowest tests listed by ttFinish().
+#ifndef TT_SLOWEST_COUNT
+#define TT_SLOWEST_COUNT 5
+#endif
+
+// Benchmark settings, the target time for a single sample in microseconds, the number of warmup & measured samples, and a limit on iterations.
+#ifndef TT_BENCH_SAMPLE_TIME
+#define TT_BENCH_SAMPLE_TIME 10000UL
+#endif
+#ifndef TT_BENCH_WARMUPS
+#define TT_BENCH_WARMUPS 1
+#endif
+#ifndef TT_BENCH_SAMPLES
+#define TT_BENCH_SAMPLES 9
+#endif
+#ifndef TT_BENCH_MAX_ITERATIONS
+#define TT_BENCH_MAX_ITERATIONS 1000000000UL
+#endif
+
+// Default percentage slowdown of a benchmark compared with the baseline that counts as a regression, and number of times to remeasure before failing.
+#ifndef TT_BENCH_THRESHOLD
+#define TT_BENCH_THRESHOLD 10
+#endif
+#ifndef TT_BENCH_RETRIES
+#define TT_BENCH_RETRIES 2
+#endif
+#ifndef TT_LAST_FAILED_FILE
+#define TT_LAST_FAILED_FILE ".tinytest-failed"
+#endif
+
+// Version of the results file format, change if the format changes.
+#define RESULTS_FILE_VERSION 1
+#define LAST_FAILED_FILE_VERSION 1
+
+/* Output of a test running on a pool thread is captured in a buffer, & printed in test order by the main thread. All output from this
+	file goes through tt_putchar(), so it is redirected here. */
+#ifdef TT_WANT_THREADS
+typedef struct {
+    char* buf;
+    size_t len, size;
+} capture_t;
+static TT_THREAD_LOCAL capture_t* f_capture;		// Non-NULL while a pool thread is running a test.
+static int capture_grow(capture_t* cap);
+
+static void capture_putchar(char c) {
+    if (NULL == f_capture)
+        tt_putchar(c);
+    else if ((f_capture->len < f_capture->size) || capture_grow(f_capture))
+        f_capture->buf[f_capture->len++] = c;
+}
+#undef tt_putchar
+#define tt_putchar(c_) capture_putchar(c_)
+#endif
+
 // Printf defers to TT_VPRINTF defined in tinytest_local.h
 #ifndef TT_VPRINTF
 #define TT_VPRINTF tt_vprintf
 
-#ifndef TT_VPRINTF_BUFLEN
-#error "TT_VPRINTF_BUFLEN must be explicitly defined."
+/* Types used for converting numbers. Targets that do not print 64 bit values can define TT_VPRINTF_NO_LONG_LONG to save space & time,
+	then `%lld' & `%llu' values are truncated to long & unsigned long. */
+#ifdef TT_VPRINTF_NO_LONG_LONG
+typedef unsigned long vprintf_uint_t;
+typedef long vprintf_int_t;
+#else
+typedef unsigned long long vprintf_uint_t;
+typedef long long vprintf_int_t;
+#endif
+
+/* Decimal numbers are converted by repeated subtraction of powers of ten, which is much faster than division on targets like the AVR
+	that have no hardware divide. At most 9 subtractions per digit. */
+static const vprintf_uint_t POWERS_OF_10[] = {
+    1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL, 100000000UL, 1000000000UL,
+#ifndef TT_VPRINTF_NO_LONG_LONG
+    10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL, 1000000000000000ULL,
+    10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL,
 #endif
+};
+#define NUM_POWERS_OF_10 ((int)(sizeof(POWERS_OF_10) / sizeof(POWERS_OF_10[0])))
 
+static void put_repeat(char c, int n) {
+    while (n-- > 0)
+        tt_putchar(c);
+}
+
+/* Minimal vprintf. Format specifiers are `%[-][0][width][l|ll]type' where type is one of `d', `u', `x', `X', `c', `s', `%', and `P' for
+	a pgm string if TT_VPRINTF_PSTR is defined. A `-' left justifies in the field width, a `0' fills numbers with zeros. */
 static void tt_vprintf(tt_pgm_str_t fmt, va_list args) {
-    union {
-        long int i;
-        unsigned long int u;
-        const char *str;			// Normal string in RAM.
-        tt_pgm_str_t pstr;			/* Fixed string, AVR stores in Flash, non-AVR targets define this type as 'const char*', but is OK
-										to have two union members of same type. */
-    } a;    						// Holds value currently being converted.
     char c;    						// Holds a char from the format string.
-    char buf[TT_VPRINTF_BUFLEN]; 	// Reverse formatted number.
-    char* pb;    					// Used as pointer to an element in buf.
-    char informat = 0; 				// Start off not reading a format.
-    char base;						// Number base.
-	char fill_zero;					// True for zero fill.
-
-    // Start scanning.
-    while ('\0' != (c = (*fmt++))) {
-        if (informat) {
-            switch (c) {
-            case 'x':					// Hex int...
-                base = 16;
-                a.u = va_arg(args, unsigned);
-				fill_zero = 1;
-                goto print_unsigned;
-
-			case 'd':            		// Signed decimal integer...
-                a.i = va_arg(args, int);
-				fill_zero = 0;
-                if (a.i < 0) {			// Handle negative integer...
-                    tt_putchar('-');
-                    a.u = -a.i;
-                }
-print_unsigned:
-                pb = buf + sizeof(buf) - 1;		// Last element.
-				*pb-- = '\0';					// Terminate.
-                do {							// Fill with digits from least significant.
-                    *pb = (char)(a.u % base) + '0';
-                    if (*pb > '9')
-                        *pb += 'a' - ('9' + 1);
-                    --pb;
-                    a.u /= base;
-                } while (a.u > 0);
-				if (fill_zero) {				// Zero fill...
-					while (pb > buf)
-						*pb-- = '0';
-				}
-				a.str = pb + 1;
-                goto print_string;
-
-            case 's':		           				// Char string in RAM...
-                a.str = va_arg(args, const char*);
-print_string:
-                while ('\0' != (c = (*a.str++)))
-                    tt_putchar(c);
-                goto done_format;
 
-#ifdef TT_VPRINTF_PSTR
-            case 'P':		           				// Pstring if not same as RAM string...
-                a.pstr = va_arg(args, tt_pgm_str_t);
-                while ('\0' != (c = (tt_pgm_str_read(a.pstr++))))
-                    tt_putchar(c);
-                goto done_format;
-#endif
+    while ('\0' != (c = tt_pgm_str_read(fmt++))) {
+        char left = 0;				// True for left justify.
+        char fill = ' ';			// Fill char for right justify.
+        char longs = 0;				// Count of `l' length modifiers.
+        char neg = 0;				// True for negative decimal.
+        int width = 0;				// Field width, reduced by the length of the value to give the padding.
+        int ndigits;
+        vprintf_uint_t u;			// Holds value currently being converted.
+        const char* str;
 
-			case '%':						// Literal `%'...
-                tt_putchar(c);
-done_format:    informat = 0;
+        if ('%' != c) {				// Not part of a format, just print it.
+            tt_putchar(c);
+            continue;
+        }
+
+        // Read flags, width & length.
+        for (;;) {
+            c = tt_pgm_str_read(fmt++);
+            if ('-' == c)
+                left = 1;
+            else if ('0' == c)
+                fill = '0';
+            else
                 break;
+        }
+        while ((c >= '0') && (c <= '9')) {
+            width = width * 10 + (c - '0');
+            c = tt_pgm_str_read(fmt++);
+        }
+        while ('l' == c) {
+            ++longs;
+            c = tt_pgm_str_read(fmt++);
+        }
 
-			default:						// Ignore nything else.
-				break;
+        switch (c) {
+        case 'd': {					// Signed decimal integer...
+            vprintf_int_t i = (longs > 1) ? (vprintf_int_t)va_arg(args, long long) : (longs > 0) ? va_arg(args, long) : va_arg(args, int);
+            if (i < 0) {
+                neg = 1;
+                u = (vprintf_uint_t)0 - (vprintf_uint_t)i;
             }
+            else
+                u = (vprintf_uint_t)i;
+            goto print_decimal;
         }
-        else { // Normal character or looking for a '%'.
-            if ('%' == c) {		// We have a format spec coming, default to base 10.
-                informat = 1;
-                base = 10;
+
+        case 'u':					// Unsigned decimal integer...
+            u = (longs > 1) ? (vprintf_uint_t)va_arg(args, unsigned long long) : (longs > 0) ? va_arg(args, unsigned long) : va_arg(args, unsigned);
+print_decimal:
+            for (ndigits = 1; (ndigits < NUM_POWERS_OF_10) && (u >= POWERS_OF_10[ndigits]); ++ndigits)
+                ;
+            width -= ndigits + neg;
+            if (!left && (' ' == fill))
+                put_repeat(' ', width);
+            if (neg)
+                tt_putchar('-');
+            if (!left && ('0' == fill))
+                put_repeat('0', width);
+            while (ndigits-- > 0) {		// Digits from most significant, each by repeated subtraction.
+                char digit = '0';
+                while (u >= POWERS_OF_10[ndigits]) {
+                    u -= POWERS_OF_10[ndigits];
+                    ++digit;
+                }
+                tt_putchar(digit);
             }
-            else
-                tt_putchar(c);	// Not part of a format, just print it.
+            break;
+
+        case 'x':					// Hex integer...
+        case 'X':
+            u = (longs > 1) ? (vprintf_uint_t)va_arg(args, unsigned long long) : (longs > 0) ? va_arg(args, unsigned long) : va_arg(args, unsigned);
+            for (ndigits = 1; (ndigits < (int)sizeof(u) * 2) && (0 != (u >> (4 * ndigits))); ++ndigits)
+                ;
+            width -= ndigits;
+            if (!left)
+                put_repeat(fill, width);
+            while (ndigits-- > 0) {		// Digits from most significant by shifting.
+                char digit = (char)((u >> (4 * ndigits)) & 0xf);
+                tt_putchar((char)(digit + ((digit < 10) ? '0' : (c - 'x' + 'a' - 10))));
+            }
+            break;
+
+        case 'c':					// Single char...
+            put_repeat(' ', left ? 0 : width - 1);
+            tt_putchar((char)va_arg(args, int));
+            width -= 1;
+            break;
+
+        case 's':		           	// Char string in RAM...
+            str = va_arg(args, const char*);
+            if ((width > 0) && !left)
+                put_repeat(' ', width - (int)strlen(str));
+            while ('\0' != (c = (*str++))) {
+                tt_putchar(c);
+                --width;
+            }
+            break;
+
+#ifdef TT_VPRINTF_PSTR
+        case 'P': {		           	// Pstring if not same as RAM string...
+            tt_pgm_str_t pstr = va_arg(args, tt_pgm_str_t);
+            if ((width > 0) && !left) {
+                tt_pgm_str_t p = pstr;
+                while ('\0' != tt_pgm_str_read(p))
+                    ++p;
+                put_repeat(' ', width - (int)(p - pstr));
+            }
+            while ('\0' != (c = (tt_pgm_str_read(pstr++)))) {
+                tt_putchar(c);
+                --width;
+            }
+            break;
+        }
+#endif
+
+        case '%':					// Literal `%'...
+            tt_putchar(c);
+            break;
+
+        case '\0':					// Format ends in the middle of a specifier.
+            return;
+
+        default:					// Ignore anything else.
+            break;
         }
+
+        if (left)					// Pad left justified fields.
+            put_repeat(' ', width);
     }
 }
 #endif
 
+// Set while a property test runs inputs that are expected to fail, so that their output is not seen.
+static TT_THREAD_LOCAL int f_quiet;
+
 // Local printf() defers to vprintf().
-static void tt_printf(tt_pgm_str_t fmt, ...) {
+void tt_printf(tt_pgm_str_t fmt, ...) {
     va_list args;
+    if (f_quiet)
+        return;
     va_start(args, fmt);
     TT_VPRINTF(fmt, args);
     va_end(args); // Should always call this, even though it is usually a no-op.
 }
 
-// This struct holds the context of where we are when we are running a test.
+// Measurements made on a single test.
+typedef struct {
+#ifdef tt_clock
+    tt_clock_t elapsed;                 // Wall clock time for setup, test & teardown.
+    tt_clock_t cpu;                     // CPU time for the same, zero if tt_cpu_clock() is not available.
+#endif
+#ifdef TT_HAVE_ALLOC
+    unsigned long allocs;               // Number of allocations, including realloc().
+    unsigned long alloc_bytes;          // Total bytes allocated.
+    unsigned long alloc_peak;           // Peak bytes in use.
+    unsigned long leaks, leak_bytes;    // Blocks allocated by the test & not freed after teardown.
+#endif
+#ifdef tt_stack_bounds
+    unsigned long stack_peak;           // Most stack used below the point where the test was called.
+#endif
+#ifdef TT_WANT_PERF
+    unsigned long long perf[PERF_NUM_EVENTS]; // Performance counters, see PERF_EVENTS.
+    unsigned perf_valid;                // Bit set for each counter that was read.
+#endif
+    char dummy;                         // Never empty.
+} test_stats_t;
+
+#ifdef tt_stack_bounds
+// Records the test with the deepest stack.
+typedef struct {
+    tt_pgm_str_t filename;
+    int lineno;
+    tt_pgm_str_t desc;
+    unsigned long peak;
+} stack_peak_t;
+#endif
+
+#ifdef TT_HAVE_ALLOC
+// A live block allocated by the running test.
+typedef struct {
+    void* p;
+    size_t size;
+} alloc_block_t;
+
+// Records the test with the highest peak allocation.
+typedef struct {
+    tt_pgm_str_t filename;
+    int lineno;
+    tt_pgm_str_t desc;
+    unsigned long peak;
+} alloc_peak_t;
+#endif
+
+#ifdef tt_cycles
+// State of a budget assertion, the times of each run of its block.
+typedef struct {
+    int kind;                           // TT_BUDGET_CYCLES or TT_BUDGET_NS.
+    unsigned n;                         // Count of runs started.
+    unsigned long start;
+    unsigned long samples[TT_BUDGET_REPEATS];
+} budget_t;
+#endif
+
+// Results of measuring a benchmark, times are picoseconds per iteration.
+typedef struct {
+    unsigned long iterations;
+    unsigned long long median, minimum, mad;
+} bench_result_t;
+
+#ifdef TT_WANT_FILES
+// An entry read from a baseline results file, held in a list.
+typedef struct baseline_entry {
+    struct baseline_entry* next;
+    char* key;                          // Filename & description separated by a tab.
+    int is_test;                        // Set for a test, else a benchmark.
+    unsigned long long median, mad;     // For benchmarks.
+    unsigned long long elapsed;         // For tests, total elapsed time of all the lines with this key, as a test may be recorded more than once.
+    unsigned count;
+} baseline_entry_t;
+
+// A test that failed in the last run or in this one, held in a list.
+typedef struct last_failed {
+    struct last_failed* next;
+    char* filename;                     // The description follows the filename in the same allocation.
+    char* desc;
+    int lineno;
+    int failed_before, run, failed_now;
+} last_failed_t;
+
+// A file mapped by ttRunTestVectors(), held in a list. The table is first so that a pointer to it is a pointer to this.
+typedef struct vector_file {
+    tt_test_table_t table;
+    struct vector_file* next;
+    tt_vector_func_t test_func;
+    const char* path;
+    tt_pgm_str_t error;                 // If non-NULL the file could not be used, & the only case fails with this message.
+    const char* map;                    // Contents of the file.
+    size_t map_size;                    // Zero if nothing is mapped.
+    size_t* lines;                      // Offsets of the lines of a text file, which are the cases.
+} vector_file_t;
+#endif
+
+#ifdef tt_clock
+// Records the slowest tests, sorted slowest first.
+typedef struct {
+    tt_pgm_str_t filename;
+    int lineno;
+    tt_pgm_str_t desc;
+    tt_clock_t elapsed;
+} slow_test_t;
+#endif
+
+// States of a suite.
+enum { SUITE_NONE, SUITE_PENDING, SUITE_STARTED };
+
+// This struct holds the context of the whole run, only the main thread uses it while tests are running on threads.
 static struct {
-    jmp_buf here;                       // Used to implement immediate exit from test function on failures.
-    tt_pgm_str_t tf_filename; 			// Filename of currently running test function.
-    int tf_lineno;                      // Line number of currently running test function.
-    tt_pgm_str_t test_desc;  			// Description of test, e.g. "test_foo(1245)".
     int pass_count, fail_count, ignore_count; // Count of the number of tests that have been passed/failed/ignored.
     const char* groupstr;   			// If non-NULL then only test descriptions containing this string are run.
     tt_fixture_func_t setup, teardown;  // User functions called before & after a test. May be NULL.
     tt_fixture_func_t dump;   			// User function to emit diagnostics on a fail. May be NULL.
     int output_mode;                    // Controls verbosity of output.
+    int test_index;                     // Count of selected tests, used to share them out between parallel workers.
+    int jobs, worker;                   // Number of parallel workers & index of this worker. Jobs is zero if not running in parallel.
+    int worker_resume;                  // Index of the first test for this worker, set when it replaces a worker that crashed.
+    int result_fd;                      // Worker writes results to the parent on this pipe.
+    int bench_mode;                     // If set run benchmarks instead of tests.
+    int isolate;                        // If set run each test in a forked child so that a crash only fails that test.
+    int timeout_count;                  // Count of tests stopped by the watchdog.
+    int next_serial;                    // Set if the next test must not run at the same time as any other.
+    int shard, shards;                  // If shards is non-zero only tests given to this shard (from zero) are run.
+    unsigned shard_test;                // Count of selected tests, used to give them to shards.
+    unsigned long prop_seed;            // Seed for property tests, zero for a new seed each run.
+    const tt_test_table_t* next_table;  // Set if the next test is a case from a table.
+    unsigned next_case;
+    tt_fixture_func_t setup_once, teardown_once; // Suite fixtures from ttBeginSuite(), may be NULL.
+    int suite_state;                    // One of SUITE_xxx.
+    int suite_result;                   // Result of setup_once, one of TINY_TEST_xxx.
+#ifdef TT_WANT_THREADS
+    int suite_first;                    // Index in the thread pool of the first test in the suite.
+#endif
+#ifdef TT_WANT_THREADS
+    int collecting;                     // If set ttRunTest() adds tests to the thread pool instead of running them.
+#endif
+#ifdef TT_WANT_REGISTRY
+    int registry_select;                // Index of the only registered test to run, or negative for all tests.
+    int next_registered;                // Set if the next test is a registered test.
+#endif
+#ifdef tt_watchdog_start
+    unsigned long timeout;              // Default watchdog timeout for tests in milliseconds, zero for none.
+    unsigned long next_timeout;         // Timeout for the next test only, if have_next_timeout is set.
+    int have_next_timeout;
+#endif
+#ifdef tt_clock
+    tt_clock_t time_limit;              // If non-zero then tests taking longer than this many microseconds fail.
+    tt_clock_t start_time;              // Time at ttStart().
+    tt_clock_t total_time;              // Total time for all tests.
+    slow_test_t slowest[TT_SLOWEST_COUNT];
+#endif
+#ifdef TT_HAVE_ALLOC
+    unsigned long total_allocs, total_alloc_bytes; // Totals for all tests.
+    alloc_peak_t alloc_peak;            // Test with the highest peak.
+#endif
+#ifdef tt_stack_bounds
+    unsigned long stack_limit;          // If non-zero then tests using more stack than this fail.
+    stack_peak_t stack_peak;            // Test with the deepest stack.
+#endif
+#ifdef TT_WANT_FILES
+    FILE* results_file;                 // If non-NULL results are written here.
+    baseline_entry_t* baseline;         // Benchmark results from a previous run.
+    int threshold;                      // Percentage slowdown from baseline that is a regression.
+    vector_file_t* vector_files;        // Files mapped by ttRunTestVectors().
+    int shard_sizing;                   // Set while ttSetShard() counts the tests without running them.
+    unsigned long long* shard_times;    // Time of each test from the baseline, while sizing.
+    unsigned shard_alloc;
+    int* shard_of;                      // Shard of each test, if shards are balanced by time.
+    unsigned shard_count;               // Number of tests in shard_of.
+    last_failed_t* last_failed;         // Tests that failed in the last run, or in this one.
+    const char* last_failed_filename;   // If non-NULL the failed tests are written here by ttFinish().
+    int last_failed_select;             // One of TT_LAST_FAILED_xxx.
+#endif
+#ifdef TT_HAVE_COVERAGE
+    const char* coverage_dir;           // If non-NULL the coverage of each test is dumped here.
+    unsigned coverage_count;            // Count of tests run by this process.
+    int suite_coverage;                 // Non-zero if the suite fixtures are covered by the test below.
+    unsigned long suite_coverage_pid;
+    unsigned suite_coverage_test;
+#endif
 } f_ctx;
 
+// This struct holds the context of where we are when we are running a test. Each thread running tests has its own.
+static TT_THREAD_LOCAL struct {
+    jmp_buf here;                       // Used to implement immediate exit from test function on failures.
+    tt_pgm_str_t tf_filename; 			// Filename of currently running test function.
+    int tf_lineno;                      // Line number of currently running test function.
+    tt_pgm_str_t test_desc;  			// Description of test, e.g. "test_foo(1245)".
+    const tt_test_table_t* table;       // If non-NULL the test is a case from this table, which describes it.
+    unsigned case_index;
+    tt_fixture_func_t setup, teardown;  // Fixture functions for the current test, copied from f_ctx when the test was registered.
+    tt_fixture_func_t dump;
+    int suite_result;                   // Result of the suite setup, the test is not run unless TINY_TEST_SUCCESS.
+    test_stats_t stats;                 // Measurements for the last test run.
+#ifdef tt_watchdog_start
+    unsigned long test_timeout;         // Timeout for the current test.
+#endif
+#ifdef TT_HAVE_ALLOC
+    int alloc_active;                   // Allocations are only tracked while a test is running.
+    unsigned alloc_nblocks;             // Number of live blocks in alloc_blocks.
+    unsigned long alloc_in_use;         // Bytes in live blocks.
+    alloc_block_t alloc_blocks[TT_ALLOC_TRACK_MAX];
+#endif
+#ifdef tt_stack_bounds
+    char* stack_ref;                    // Address in the frame of the function that calls the test.
+    char* stack_start;                  // Painted region of the stack.
+    char* stack_end;
+#endif
+#ifdef TT_WANT_PERF
+    pid_t perf_pid;                     // Process that opened the counters, forked children open their own. Zero if not open.
+    int perf_fd[PERF_NUM_EVENTS];       // Counters for this thread, -1 if not available.
+#endif
+#ifdef TT_HAVE_COVERAGE
+    unsigned long coverage_pid;         // The coverage of a test is in a directory named for the process that ran it & a count.
+    unsigned coverage_test;
+    int coverage_keep;                  // Do not reset the counters before the test, as they hold the coverage of setup_once.
+#endif
+#ifdef tt_cycles
+    budget_t budget;                    // The budget assertion that is running.
+#endif
+} t_ctx;
+
 void ttRegisterFixture(tt_fixture_func_t setup, tt_fixture_func_t dump, tt_fixture_func_t teardown) {
     f_ctx.setup = setup;
     f_ctx.teardown = teardown;
     f_ctx.dump = dump;
 }
 
+/* Suite fixtures are called lazily, setup_once by suite_start() before the first selected test in the suite, & teardown_once by 
+	ttEndSuite() if setup_once was called & succeeded. */
+void ttBeginSuite(tt_fixture_func_t setup_once, tt_fixture_func_t teardown_once) {
+    ttEndSuite();
+    f_ctx.setup_once = setup_once;
+    f_ctx.teardown_once = teardown_once;
+    f_ctx.suite_state = SUITE_PENDING;
+    f_ctx.suite_result = TINY_TEST_SUCCESS;
+}
+
+// Call a suite fixture, returns one of TINY_TEST_xxx. Failures are reported against the given test.
+static int run_suite_fixture(tt_fixture_func_t fixture, tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc) {
+    int exc;
+    if (NULL == fixture)
+        return TINY_TEST_SUCCESS;
+    t_ctx.tf_filename = filename;
+    t_ctx.tf_lineno = lineno;
+    t_ctx.test_desc = desc;
+    t_ctx.table = NULL;					// Described by the table name.
+    exc = setjmp(t_ctx.here);
+    if (TINY_TEST_SUCCESS == exc)
+        fixture();
+    return exc;
+}
+
+// Called for each selected test, calls setup_once for the first test in a suite. Returns the result of setup_once.
+static int suite_start(tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc) {
+    if (SUITE_PENDING == f_ctx.suite_state) {
+        f_ctx.suite_result = run_suite_fixture(f_ctx.setup_once, filename, lineno, desc);
+        f_ctx.suite_state = SUITE_STARTED;
+    }
+    return f_ctx.suite_result;
+}
+
 // Called at the start of the test.
 void ttStart(int output_mode, const char* groupstr) {
 	memset(&f_ctx, 0, sizeof(f_ctx));		// Most things are zeroed.
+	memset(&t_ctx, 0, sizeof(t_ctx));
     f_ctx.output_mode = output_mode;
     f_ctx.groupstr = groupstr;
+#ifdef tt_clock
+    f_ctx.start_time = tt_clock();
+#endif
+#ifdef TT_WANT_REGISTRY
+    f_ctx.registry_select = -1;
+#endif
 }
 
-void ttDiagnostic(tt_pgm_str_t msg, ...) {
-    if (NULL != msg) {
-		if (TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode) { // Only in verbose emit diagnostic messages.
-			va_list args;
-			va_start(args, msg);
-			tt_printf(TT_PSTR("# "));
-			TT_VPRINTF(msg, args);
-			tt_printf(TT_PSTR(TT_NEWLINE));
-			va_end(args);
-		}
+#ifdef TT_WANT_FILES
+/* Results files are tab separated text, with a header line giving the version, then a line per test or benchmark:
+	"tinytest-results <version>"
+	"test <filename> <description> <pass|fail|ignore|timeout> <elapsed us> <cpu us>"
+	"perf <filename> <description> <instructions> <cycles> <cache misses> <branch misses> <page faults>" follows a test line, 
+		if any performance counters are available, unavailable counters are "-". 
+	"bench <filename> <description> <median ps/op> <MAD ps/op> <min ps/op> <iterations>"
+	"end <version> <shard> <shards> <passed> <failed> <ignored> <timed out>" is written by ttFinish(), so a file without it is from a 
+		run that did not finish. The shard is from 1, & is 1 of 1 if not sharding. The counts are the totals printed by ttFinish(), 
+		which may include failures that have no test line, e.g. from a suite teardown.
+*/
+int ttWriteResults(const char* filename) {
+    f_ctx.results_file = fopen(filename, "w");
+    if (NULL == f_ctx.results_file)
+        return -1;
+    fprintf(f_ctx.results_file, "tinytest-results\t%d\n", RESULTS_FILE_VERSION);
+    return 0;
+}
+
+// Split a line into tab separated fields in place, returns number of fields.
+static int split_fields(char* line, char* fields[], int max_fields) {
+    int n = 0;
+    line[strcspn(line, "\r\n")] = '\0';
+    while (n < max_fields) {
+        fields[n++] = line;
+        line = strchr(line, '\t');
+        if (NULL == line)
+            break;
+        *line++ = '\0';
     }
+    return n;
 }
 
-void tt_abort(int reason) {
-    longjmp(f_ctx.here, reason); // Make magic happen...
+static baseline_entry_t* find_baseline(tt_pgm_str_t filename, tt_pgm_str_t desc, int is_test) {
+    baseline_entry_t* e;
+    size_t fn_len = strlen(filename);
+    for (e = f_ctx.baseline; NULL != e; e = e->next) {
+        if ((e->is_test == is_test) && (0 == strncmp(e->key, filename, fn_len)) && ('\t' == e->key[fn_len]) && 
+          (0 == strcmp(e->key + fn_len + 1, desc)))
+            return e;
+    }
+    return NULL;
 }
 
-/** Print a failure diagnostic, a factor of the TT_ASSERT_xxx() macros. If msg is non-NULL, it is passed through
-    vprintf, together with any trailing arguments. */
-void tt_print_fail_message(tt_pgm_str_t filename, int lineno, tt_pgm_str_t msg, ...) {
-    va_list args;
+int ttReadBaseline(const char* filename, int threshold_percent) {
+    char line[512];
+    char* fields[8];
+    FILE* fp;
 
-    switch (f_ctx.output_mode) {
-	default:	 					// No output!
-		break;
- 	case TT_OUTPUT_MODE_CONCISE:
-        tt_putchar('F');
-		break;
-	case TT_OUTPUT_MODE_DEFAULT:	 // Default & verbose both emit diagnostics for failures.
-		// Fall through...
-	case TT_OUTPUT_MODE_VERBOSE:
-        tt_printf(TT_PSTR("%s:%d: "), filename, lineno);
-        tt_printf(TT_PSTR("[%s:%d %s] FAIL: "), f_ctx.tf_filename, f_ctx.tf_lineno, f_ctx.test_desc);
-        va_start(args, msg);
-        TT_VPRINTF(msg, args);
-        va_end(args);
-		tt_printf(TT_PSTR("." TT_NEWLINE));		// A sentence must always end with a full stop.
-		break;
+    if (threshold_percent < 0)			// Would wrap around in the unsigned arithmetic of is_regression().
+        return -3;
+    f_ctx.threshold = threshold_percent;
+    fp = fopen(filename, "r");
+    if (NULL == fp)
+        return -1;
+    if ((NULL == fgets(line, sizeof(line), fp)) || (2 != split_fields(line, fields, 8)) ||
+      (0 != strcmp(fields[0], "tinytest-results")) || (RESULTS_FILE_VERSION != atoi(fields[1]))) {
+        fclose(fp);
+        return -2;
+    }
+    while (NULL != fgets(line, sizeof(line), fp)) {
+        int n = split_fields(line, fields, 8);
+        int is_test = (6 == n) && (0 == strcmp(fields[0], "test"));
+        baseline_entry_t* e;
+        if (!is_test && !((7 == n) && (0 == strcmp(fields[0], "bench"))))
+            continue;
+        if (is_test && (NULL != (e = find_baseline(fields[1], fields[2], 1)))) { // Run more than once, e.g. in two suites.
+            e->elapsed += strtoull(fields[4], NULL, 10);
+            e->count += 1;
+            continue;
+        }
+        e = (baseline_entry_t*)malloc(sizeof(baseline_entry_t));
+        if (NULL == e)
+            break;
+        e->key = (char*)malloc(strlen(fields[1]) + strlen(fields[2]) + 2);
+        if (NULL == e->key) {
+            free(e);
+            break;
+        }
+        strcat(strcat(strcpy(e->key, fields[1]), "\t"), fields[2]);
+        e->is_test = is_test;
+        e->median = is_test ? 0ULL : strtoull(fields[3], NULL, 10);
+        e->mad = is_test ? 0ULL : strtoull(fields[4], NULL, 10);
+        e->elapsed = is_test ? strtoull(fields[4], NULL, 10) : 0ULL;
+        e->count = 1;
+        e->next = f_ctx.baseline;
+        f_ctx.baseline = e;
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* The last failed file is tab separated text, with a header line giving the version, then a line per test:
+	"tinytest-failed <version>"
+	"<filename> <line number> <description>"
+*/
+static last_failed_t* find_last_failed(tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc) {
+    last_failed_t* e;
+    for (e = f_ctx.last_failed; NULL != e; e = e->next) {
+        if ((e->lineno == lineno) && (0 == strcmp(e->filename, filename)) && (0 == strcmp(e->desc, desc)))
+            return e;
+    }
+    return NULL;
+}
+
+// Add a test to the end of the list, so that the file keeps the order of the tests.
+static last_failed_t* add_last_failed(tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc) {
+    last_failed_t** link = &f_ctx.last_failed;
+    last_failed_t* e = (last_failed_t*)malloc(sizeof(last_failed_t));
+    if (NULL == e)
+        return NULL;
+    e->filename = (char*)malloc(strlen(filename) + strlen(desc) + 2);
+    if (NULL == e->filename) {
+        free(e);
+        return NULL;
+    }
+    e->desc = strcpy(e->filename, filename) + strlen(filename) + 1;
+    strcpy(e->desc, desc);
+    e->lineno = lineno;
+    e->failed_before = e->run = e->failed_now = 0;
+    e->next = NULL;
+    while (NULL != *link)
+        link = &(*link)->next;
+    *link = e;
+    return e;
+}
+
+int ttReadLastFailed(const char* filename) {
+    char line[512];
+    char* fields[4];
+    FILE* fp;
+
+    f_ctx.last_failed_filename = filename;
+    fp = fopen(filename, "r");
+    if (NULL == fp)
+        return (ENOENT == errno) ? 0 : -1;
+    if ((NULL == fgets(line, sizeof(line), fp)) || (2 != split_fields(line, fields, 4)) ||
+      (0 != strcmp(fields[0], "tinytest-failed")) || (LAST_FAILED_FILE_VERSION != atoi(fields[1]))) {
+        fclose(fp);
+        return -2;
+    }
+    while (NULL != fgets(line, sizeof(line), fp)) {
+        last_failed_t* e;
+        if ((3 == split_fields(line, fields, 4)) && (NULL != (e = add_last_failed(fields[0], atoi(fields[1]), fields[2]))))
+            e->failed_before = 1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+void ttSelectLastFailed(int which) {
+    f_ctx.last_failed_select = which;
+    f_ctx.shard_test = 0;				// Shards are given the same tests in each pass.
+}
+
+static int last_failed_selected(tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc) {
+    const last_failed_t* e;
+    if (TT_LAST_FAILED_ALL == f_ctx.last_failed_select)
+        return 1;
+    e = find_last_failed(filename, lineno, desc);
+    return ((NULL != e) && e->failed_before) == (TT_LAST_FAILED_ONLY == f_ctx.last_failed_select);
+}
+
+static void note_last_failed(tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc, int result) {
+    int failed = (TINY_TEST_FAIL == result) || (TINY_TEST_TIMEOUT == result);
+    last_failed_t* e;
+    if (NULL == f_ctx.last_failed_filename)
+        return;
+    e = find_last_failed(filename, lineno, desc);
+    if ((NULL == e) && failed)
+        e = add_last_failed(filename, lineno, desc);
+    if (NULL != e) {
+        e->run = 1;
+        e->failed_now |= failed;
+    }
+}
+
+// Write the failed tests & free the list.
+static void write_last_failed(void) {
+    FILE* fp = (NULL != f_ctx.last_failed_filename) ? fopen(f_ctx.last_failed_filename, "w") : NULL;
+    if (NULL != fp)
+        fprintf(fp, "tinytest-failed\t%d\n", LAST_FAILED_FILE_VERSION);
+    while (NULL != f_ctx.last_failed) {
+        last_failed_t* e = f_ctx.last_failed;
+        f_ctx.last_failed = e->next;
+        if ((NULL != fp) && (e->run ? e->failed_now : e->failed_before))
+            fprintf(fp, "%s\t%d\t%s\n", e->filename, e->lineno, e->desc);
+        free(e->filename);
+        free(e);
+    }
+    if (NULL != fp)
+        fclose(fp);
+    f_ctx.last_failed_filename = NULL;
+}
+
+// Test function for a record of a vector file, a text record is the line without the line ending.
+static void vector_run(const tt_test_table_t* table, unsigned index) {
+    const vector_file_t* vf = (const vector_file_t*)table;
+    const char* rec;
+    size_t len;
+
+    if (NULL != vf->error) {
+        tt_print_fail_message(t_ctx.tf_filename, t_ctx.tf_lineno, vf->error, vf->path, (unsigned long)table->size);
+        tt_abort(TINY_TEST_FAIL);
+    }
+    if (table->size > 0) {
+        vf->test_func(vf->map + (size_t)index * table->size, table->size);
+        return;
+    }
+    rec = vf->map + vf->lines[index];
+    len = strcspn(rec, "\n");			// The mapping is padded with zeroes to a page, or ends with a newline that we added.
+    if ((len > 0) && ('\r' == rec[len - 1]))
+        len -= 1;
+    vf->test_func(rec, len);
+}
+
+static void vector_describe(const tt_test_table_t* table, unsigned index) {
+    const vector_file_t* vf = (const vector_file_t*)table;
+    unsigned long n = index;
+    if (NULL != vf->error) {
+        tt_printf(TT_PSTR(TT_FMT_PSTR "[%s]"), table->name, vf->path);
+        return;
+    }
+    if (0 == table->size) {				// Count the lines up to this one.
+        const char* p;
+        n = 1UL;
+        for (p = vf->map; p < (vf->map + vf->lines[index]); ++p)
+            n += (unsigned long)('\n' == *p);
+    }
+    tt_printf(TT_PSTR(TT_FMT_PSTR "[%s:%lu]"), table->name, vf->path, n);
+}
+
+// Map a file of test vectors & find the records.
+static void vector_map(vector_file_t* vf) {
+    struct stat st;
+    int fd = open(vf->path, O_RDONLY);
+    void* map;
+    size_t i, n;
+
+    vf->error = TT_PSTR("Cannot read test vectors from `%s'");
+    if (fd < 0)
+        return;
+    if (0 != fstat(fd, &st)) {
+        close(fd);
+        return;
+    }
+    if (0 == st.st_size) {				// Empty, so no cases.
+        close(fd);
+        vf->error = NULL;
+        vf->table.count = 0;
+        return;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == map)
+        return;
+    vf->map = (const char*)map;
+    vf->map_size = (size_t)st.st_size;
+    vf->error = NULL;
+
+    if (vf->table.size > 0) {
+        if (0 != (vf->map_size % vf->table.size))
+            vf->error = TT_PSTR("Test vectors file `%s' is not a whole number of %lu byte records");
+        else
+            vf->table.count = (unsigned)(vf->map_size / vf->table.size);
+        return;
+    }
+    if (0 == (vf->map_size % (size_t)sysconf(_SC_PAGESIZE))) { // No zero padding after the last line, so it must end with a newline.
+        if ('\n' != vf->map[vf->map_size - 1]) {
+            vf->error = TT_PSTR("Test vectors file `%s' must end with a newline");
+            return;
+        }
+    }
+    for (n = 0, i = 0; i < vf->map_size; i += strcspn(vf->map + i, "\n") + 1) { // Count the records, then fill in their offsets.
+        if (('\n' != vf->map[i]) && ('\r' != vf->map[i]) && ('#' != vf->map[i]))
+            ++n;
+    }
+    vf->lines = (size_t*)malloc((n > 0 ? n : 1) * sizeof(size_t));
+    if (NULL == vf->lines) {
+        vf->error = TT_PSTR("Out of memory reading test vectors from `%s'");
+        return;
+    }
+    for (n = 0, i = 0; i < vf->map_size; i += strcspn(vf->map + i, "\n") + 1) {
+        if (('\n' != vf->map[i]) && ('\r' != vf->map[i]) && ('#' != vf->map[i]))
+            vf->lines[n++] = i;
+    }
+    vf->table.count = (unsigned)n;
+}
+
+void ttRunTestVectors(tt_vector_func_t test_func, const char* path, size_t size, tt_pgm_str_t filename, int lineno, tt_pgm_str_t name) {
+    vector_file_t* vf = (vector_file_t*)calloc(1, sizeof(vector_file_t) + strlen(path) + 1);
+    if (NULL == vf) {
+        tt_printf(TT_PSTR("Out of memory reading test vectors from `%s'." TT_NEWLINE), path);
+        f_ctx.fail_count += 1;
+        return;
+    }
+    vf->path = strcpy((char*)(vf + 1), path);
+    vf->test_func = test_func;
+    vf->table.name = name;
+    vf->table.size = size;
+    vf->table.count = 1;				// Just the failure if the file cannot be used.
+    vf->table.lineno = lineno;
+    vf->table.run = vector_run;
+    vf->table.describe = vector_describe;
+    vector_map(vf);
+    vf->next = f_ctx.vector_files;		// Kept until ttFinish() as the thread pool runs the cases later.
+    f_ctx.vector_files = vf;
+    ttRunTestTable(&vf->table, filename);
+}
+
+// Close the results file, write the failed tests & free the baseline.
+static void close_files(void) {
+    write_last_failed();
+    if (NULL != f_ctx.results_file) {
+        fprintf(f_ctx.results_file, "end\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n", RESULTS_FILE_VERSION, (f_ctx.shards > 0) ? (f_ctx.shard + 1) : 1, 
+          (f_ctx.shards > 0) ? f_ctx.shards : 1, f_ctx.pass_count, f_ctx.fail_count, f_ctx.ignore_count, f_ctx.timeout_count);
+        fclose(f_ctx.results_file);
+        f_ctx.results_file = NULL;
+    }
+    while (NULL != f_ctx.baseline) {
+        baseline_entry_t* e = f_ctx.baseline;
+        f_ctx.baseline = e->next;
+        free(e->key);
+        free(e);
+    }
+    while (NULL != f_ctx.vector_files) {
+        vector_file_t* vf = f_ctx.vector_files;
+        f_ctx.vector_files = vf->next;
+        if (vf->map_size > 0)
+            munmap((void*)vf->map, vf->map_size);
+        free(vf->lines);
+        free(vf);
+    }
+    free(f_ctx.shard_of);
+    f_ctx.shard_of = NULL;
+}
+#endif
+
+#ifdef tt_clock
+void ttSetTimeLimit(tt_clock_t limit_us) {
+    f_ctx.time_limit = limit_us;
+}
+
+#ifndef TT_WANT_TOKENS
+// Print a value in thousandths with three decimal places.
+static void print_milli(unsigned long long t) {
+    tt_printf(TT_PSTR("%llu.%03u"), t / 1000, (unsigned)(t % 1000));
+}
+
+// Print a time in microseconds as milliseconds.
+static void print_time(tt_clock_t t) {
+    print_milli(t);
+    tt_printf(TT_PSTR("ms"));
+}
+#endif
+
+// Add a test's time to the total and keep it if it is one of the slowest.
+static void record_time(tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc, tt_clock_t elapsed) {
+    int i;
+
+    f_ctx.total_time += elapsed;
+    for (i = TT_SLOWEST_COUNT; (i > 0) && ((NULL == f_ctx.slowest[i-1].desc) || (elapsed > f_ctx.slowest[i-1].elapsed)); --i) {
+        if (i < TT_SLOWEST_COUNT)
+            f_ctx.slowest[i] = f_ctx.slowest[i-1];
+    }
+    if (i < TT_SLOWEST_COUNT) {
+        f_ctx.slowest[i].filename = filename;
+        f_ctx.slowest[i].lineno = lineno;
+        f_ctx.slowest[i].desc = desc;
+        f_ctx.slowest[i].elapsed = elapsed;
+    }
+}
+#endif
+
+#ifdef TT_HAVE_ALLOC
+/* Allocation tracking. Blocks allocated while a test is running are kept in a table so that frees can be matched & leaks found, 
+	anything freed that is not in the table was allocated outside the test and is ignored. */
+void ttNoteAlloc(void* p, size_t size) {
+    if (!t_ctx.alloc_active || (NULL == p))
+        return;
+    t_ctx.stats.allocs += 1;
+    t_ctx.stats.alloc_bytes += (unsigned long)size;
+    if (t_ctx.alloc_nblocks < TT_ALLOC_TRACK_MAX) {
+        t_ctx.alloc_blocks[t_ctx.alloc_nblocks].p = p;
+        t_ctx.alloc_blocks[t_ctx.alloc_nblocks].size = size;
+        t_ctx.alloc_nblocks += 1;
+        t_ctx.alloc_in_use += (unsigned long)size;
+        if (t_ctx.alloc_in_use > t_ctx.stats.alloc_peak)
+            t_ctx.stats.alloc_peak = t_ctx.alloc_in_use;
+    }
+}
+
+void ttNoteFree(void* p) {
+    unsigned i;
+    if (!t_ctx.alloc_active || (NULL == p))
+        return;
+    for (i = t_ctx.alloc_nblocks; i > 0; --i) {		// Search from the end as recent blocks are usually freed first.
+        if (p == t_ctx.alloc_blocks[i-1].p) {
+            t_ctx.alloc_in_use -= (unsigned long)t_ctx.alloc_blocks[i-1].size;
+            t_ctx.alloc_nblocks -= 1;
+            t_ctx.alloc_blocks[i-1] = t_ctx.alloc_blocks[t_ctx.alloc_nblocks];
+            break;
+        }
+    }
+}
+
+unsigned long ttAllocCount(void) {
+    return t_ctx.stats.allocs;
+}
+unsigned long ttAllocPeak(void) {
+    return t_ctx.stats.alloc_peak;
+}
+
+static void alloc_start(void) {
+    t_ctx.alloc_nblocks = 0;
+    t_ctx.alloc_in_use = 0UL;
+    t_ctx.alloc_active = 1;
+}
+static void alloc_stop(void) {
+    t_ctx.alloc_active = 0;
+    t_ctx.stats.leaks = t_ctx.alloc_nblocks;
+    t_ctx.stats.leak_bytes = t_ctx.alloc_in_use;
+}
+
+static void record_alloc(tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc, const test_stats_t* stats) {
+    f_ctx.total_allocs += stats->allocs;
+    f_ctx.total_alloc_bytes += stats->alloc_bytes;
+    if ((NULL == f_ctx.alloc_peak.desc) || (stats->alloc_peak > f_ctx.alloc_peak.peak)) {
+        f_ctx.alloc_peak.filename = filename;
+        f_ctx.alloc_peak.lineno = lineno;
+        f_ctx.alloc_peak.desc = desc;
+        f_ctx.alloc_peak.peak = stats->alloc_peak;
+    }
+}
+#endif
+
+#ifdef TT_ALLOC_WRAP
+/* Wrappers for the standard allocator for the GNU linker option `--wrap', which links calls to malloc() to __wrap_malloc() & 
+	__real_malloc() to the real malloc(). */
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size) {
+    void* p = __real_malloc(size);
+    ttNoteAlloc(p, size);
+    return p;
+}
+void* __wrap_calloc(size_t nmemb, size_t size) {
+    void* p = __real_calloc(nmemb, size);
+    ttNoteAlloc(p, nmemb * size);
+    return p;
+}
+void* __wrap_realloc(void* ptr, size_t size) {
+    void* p = __real_realloc(ptr, size);
+    if ((NULL != p) || (0 == size)) {		// On failure the old block is untouched.
+        ttNoteFree(ptr);
+        ttNoteAlloc(p, size);
+    }
+    return p;
+}
+void __wrap_free(void* ptr) {
+    ttNoteFree(ptr);
+    __real_free(ptr);
+}
+#endif
+
+#ifdef tt_stack_bounds
+/* Stack measurement. The free stack below the caller is painted with a known value, after the test the painted region is scanned 
+	from the far end for the deepest byte that has been written. Painting is done with a plain loop as any function called would 
+	have its frame in the region being painted. */
+void ttSetStackLimit(unsigned long limit_bytes) {
+    f_ctx.stack_limit = limit_bytes;
+}
+
+#define STACK_PAINT_WORD ((unsigned long)-1 / 0xffUL * (unsigned long)(TT_STACK_PAINT & 0xff))
+#define STACK_ALIGN_UP(p_) ((char*)(((size_t)(p_) + sizeof(unsigned long) - 1) & ~(sizeof(unsigned long) - 1)))
+#define STACK_ALIGN_DOWN(p_) ((char*)((size_t)(p_) & ~(sizeof(unsigned long) - 1)))
+
+static TT_NOINLINE void stack_paint(char* ref) {
+    char here;
+    char* lo = NULL;
+    char* hi = NULL;
+    size_t start, end;
+    volatile unsigned long* p;
+
+    tt_stack_bounds(lo, hi);
+    t_ctx.stack_ref = ref;
+    t_ctx.stack_start = t_ctx.stack_end = NULL;
+    if ((NULL == lo) || (hi <= lo))
+        return;
+#ifdef TT_STACK_GROWS_UP
+    start = (size_t)&here + TT_STACK_MARGIN;
+    if (start >= (size_t)hi)
+        return;
+    end = (((size_t)hi - start) > TT_STACK_PAINT_MAX) ? (start + TT_STACK_PAINT_MAX) : (size_t)hi;
+#else
+    end = (size_t)&here - TT_STACK_MARGIN;
+    if (end <= (size_t)lo)
+        return;
+    start = ((end - (size_t)lo) > TT_STACK_PAINT_MAX) ? (end - TT_STACK_PAINT_MAX) : (size_t)lo;
+#endif
+    t_ctx.stack_start = STACK_ALIGN_UP(start);
+    t_ctx.stack_end = STACK_ALIGN_DOWN(end);
+    for (p = (volatile unsigned long*)t_ctx.stack_start; p < (volatile unsigned long*)t_ctx.stack_end; ++p)
+        *p = STACK_PAINT_WORD;
+}
+
+// Returns number of bytes of stack used below the reference, which is a little high if none of the painted region was used.
+static unsigned long stack_scan(void) {
+    const volatile unsigned long* w;
+    const volatile char* p;
+    if (NULL == t_ctx.stack_start)
+        return 0UL;
+#ifdef TT_STACK_GROWS_UP
+    for (w = (const volatile unsigned long*)t_ctx.stack_end; w > (const volatile unsigned long*)t_ctx.stack_start; --w) {
+        if (STACK_PAINT_WORD != w[-1])
+            break;
+    }
+    for (p = (const volatile char*)w; (p > t_ctx.stack_start) && ((char)TT_STACK_PAINT == p[-1]); --p)
+        ;
+    return (unsigned long)(p - t_ctx.stack_ref);
+#else
+    for (w = (const volatile unsigned long*)t_ctx.stack_start; w < (const volatile unsigned long*)t_ctx.stack_end; ++w) {
+        if (STACK_PAINT_WORD != *w)
+            break;
+    }
+    for (p = (const volatile char*)w; (p < t_ctx.stack_end) && ((char)TT_STACK_PAINT == *p); ++p)
+        ;
+    return (unsigned long)(t_ctx.stack_ref - p);
+#endif
+}
+
+static void record_stack(tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc, const test_stats_t* stats) {
+    if ((NULL == f_ctx.stack_peak.desc) || (stats->stack_peak > f_ctx.stack_peak.peak)) {
+        f_ctx.stack_peak.filename = filename;
+        f_ctx.stack_peak.lineno = lineno;
+        f_ctx.stack_peak.desc = desc;
+        f_ctx.stack_peak.peak = stats->stack_peak;
+    }
+}
+#endif
+
+#ifdef TT_WANT_PERF
+/* Performance counters. These count for the calling process only, user space only so that they work with the default 
+	perf_event_paranoid setting. They are opened on first use & again in a forked child, as counters opened by the parent would count
+	the parent. Reset & enabled around each test. A counter that was multiplexed with others, so did not count for the whole test, is 
+	not reported as its count would be too low. */
+static void perf_open(void) {
+    int i;
+    if (getpid() == t_ctx.perf_pid)
+        return;
+    for (i = 0; i < PERF_NUM_EVENTS; ++i) {
+        struct perf_event_attr attr;
+        if ((0 != t_ctx.perf_pid) && (t_ctx.perf_fd[i] >= 0))
+            close(t_ctx.perf_fd[i]);
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_EVENTS[i].type;
+        attr.config = PERF_EVENTS[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        t_ctx.perf_fd[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    t_ctx.perf_pid = getpid();
+}
+
+// Close the counters when a pool thread ends, or from ttFinish().
+static void perf_close(void) {
+    int i;
+    if (0 == t_ctx.perf_pid)
+        return;
+    for (i = 0; i < PERF_NUM_EVENTS; ++i) {
+        if (t_ctx.perf_fd[i] >= 0)
+            close(t_ctx.perf_fd[i]);
+    }
+    t_ctx.perf_pid = 0;
+}
+
+static void perf_start(void) {
+    int i;
+    for (i = 0; i < PERF_NUM_EVENTS; ++i) {
+        if (t_ctx.perf_fd[i] >= 0) {
+            ioctl(t_ctx.perf_fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(t_ctx.perf_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+static void perf_stop(void) {
+    int i;
+    for (i = 0; i < PERF_NUM_EVENTS; ++i) {
+        if (t_ctx.perf_fd[i] >= 0) {
+            unsigned long long v[3];	// Count, time enabled & time running.
+            ioctl(t_ctx.perf_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            if ((sizeof(v) == read(t_ctx.perf_fd[i], v, sizeof(v))) && (v[1] == v[2])) {
+                t_ctx.stats.perf[i] = v[0];
+                t_ctx.stats.perf_valid |= 1U << i;
+            }
+        }
+    }
+}
+#endif
+
+/* The cases of a table share the table name as their description. Wherever a test is selected or recorded by its description the index
+	of a case is added, e.g. "testFoo()[3]", so that each case can be selected & is recorded & compared with a baseline on its own. 
+	Returns desc for a test that is not from a table, else the description written to buf, which is truncated to fit. */
+#ifndef TT_CASE_DESC_MAX
+#define TT_CASE_DESC_MAX 64
+#endif
+static tt_pgm_str_t case_desc(char* buf, tt_pgm_str_t desc, const tt_test_table_t* table, unsigned case_index) {
+    char digits[12];
+    int ndigits = 0;
+    size_t n = 0;
+
+    if (NULL == table)
+        return desc;
+    do {
+        digits[ndigits++] = (char)('0' + case_index % 10U);
+        case_index /= 10U;
+    } while (case_index > 0U);
+    while ((n < TT_CASE_DESC_MAX - sizeof(digits) - 3) && ('\0' != (buf[n] = tt_pgm_str_read(desc + n))))
+        ++n;
+    buf[n++] = '[';
+    while (ndigits > 0)
+        buf[n++] = digits[--ndigits];
+    buf[n++] = ']';
+    buf[n] = '\0';
+    return buf;
+}
+
+// Record the result of a test that has been run, either here or by a parallel worker.
+static void record_result(tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc, const tt_test_table_t* table, unsigned case_index, 
+  int result, const test_stats_t* stats) {
+#ifdef TT_WANT_FILES
+    char buf[TT_CASE_DESC_MAX];
+    tt_pgm_str_t key = case_desc(buf, desc, table, case_index);
+#endif
+#ifdef tt_clock
+    record_time(filename, lineno, desc, stats->elapsed);
+#endif
+#ifdef TT_HAVE_ALLOC
+    record_alloc(filename, lineno, desc, stats);
+#endif
+#ifdef tt_stack_bounds
+    record_stack(filename, lineno, desc, stats);
+#endif
+#ifdef TT_WANT_FILES
+    note_last_failed(filename, lineno, key, result);
+    if (NULL != f_ctx.results_file) {
+        static const char* const RESULT_NAMES[] = { "pass", "fail", "ignore", "timeout" };
+        unsigned long elapsed = 0UL, cpu = 0UL;
+#ifdef tt_clock
+        elapsed = (unsigned long)stats->elapsed;
+        cpu = (unsigned long)stats->cpu;
+#endif
+        fprintf(f_ctx.results_file, "test\t%s\t%s\t%s\t%lu\t%lu\n", filename, key, RESULT_NAMES[result], elapsed, cpu);
+#ifdef TT_WANT_PERF
+        if (0 != stats->perf_valid) {
+            int i;
+            fprintf(f_ctx.results_file, "perf\t%s\t%s", filename, key);
+            for (i = 0; i < PERF_NUM_EVENTS; ++i) {
+                if (stats->perf_valid & (1U << i))
+                    fprintf(f_ctx.results_file, "\t%llu", stats->perf[i]);
+                else
+                    fprintf(f_ctx.results_file, "\t-");
+            }
+            fprintf(f_ctx.results_file, "\n");
+        }
+#endif
+    }
+#endif
+    (void)filename; (void)lineno; (void)desc; (void)table; (void)case_index; (void)result; (void)stats;
+}
+
+#ifndef TT_WANT_TOKENS
+void ttDiagnostic(tt_pgm_str_t msg, ...) {
+    if ((NULL != msg) && !f_quiet) {
+		if (TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode) { // Only in verbose emit diagnostic messages.
+			va_list args;
+			va_start(args, msg);
+			tt_printf(TT_PSTR("# "));
+			TT_VPRINTF(msg, args);
+			tt_printf(TT_PSTR(TT_NEWLINE));
+			va_end(args);
+		}
+    }
+}
+#endif
+
+void tt_abort(int reason) {
+    longjmp(t_ctx.here, reason); // Make magic happen...
+}
+
+#ifdef tt_watchdog_start
+void ttSetTimeout(unsigned long timeout_ms) {
+    f_ctx.timeout = timeout_ms;
+}
+void ttSetNextTimeout(unsigned long timeout_ms) {
+    f_ctx.next_timeout = timeout_ms;
+    f_ctx.have_next_timeout = 1;
+}
+#endif
+void ttWatchdogExpired(void) {
+    tt_abort(TINY_TEST_TIMEOUT);
+}
+
+#ifdef TT_WANT_TOKENS
+/* Tokenized output, see tinytest.h for the record format. The host decoder formats the records into the same text that would have
+	been printed. */
+static void token_put16(unsigned v) {
+    tt_putchar((char)(v & 0xff));
+    tt_putchar((char)((v >> 8) & 0xff));
+}
+static void token_put32(unsigned long v) {
+    token_put16((unsigned)(v & 0xffffU));
+    token_put16((unsigned)((v >> 16) & 0xffffU));
+}
+static void token_put64(unsigned long long v) {
+    token_put32((unsigned long)(v & 0xffffffffUL));
+    token_put32((unsigned long)(v >> 32));
+}
+static void token_start(char type) {
+    tt_putchar((char)TT_TOKEN_SYNC);
+    tt_putchar(type);
+}
+
+// The file ID is the 32 bit FNV-1a hash of the filename folded to 16 bits. The decoder computes the same hash of filenames in the source.
+unsigned tt_token_file_id(tt_pgm_str_t filename) {
+    unsigned long h = 0x811c9dc5UL;
+    char c;
+    while ('\0' != (c = tt_pgm_str_read(filename++))) {
+        h ^= (unsigned char)c;
+        h = (h * 0x01000193UL) & 0xffffffffUL;
+    }
+    return (unsigned)((h ^ (h >> 16)) & 0xffffU);
+}
+
+static void token_location(tt_pgm_str_t filename, int lineno) {
+    token_put16(tt_token_file_id(filename));
+    token_put16((unsigned)lineno);
+}
+
+// Field width of TT_FMT_HEX, e.g. 4 for `%04x', so that the decoder can print hex values the same way.
+static unsigned token_hex_width(void) {
+    tt_pgm_str_t fmt = TT_PSTR(TT_FMT_HEX);
+    unsigned width = 0;
+    char c;
+
+    while (('%' == (c = tt_pgm_str_read(fmt))) || ('0' == c) || ('-' == c))
+        ++fmt;
+    while (((c = tt_pgm_str_read(fmt++)) >= '0') && (c <= '9'))
+        width = width * 10 + (unsigned)(c - '0');
+    return width;
+}
+
+void tt_token_fail(tt_pgm_str_t filename, int lineno, int fmt_id, int nargs, ...) {
+    if ((TT_OUTPUT_MODE_QUIET != f_ctx.output_mode) && !f_quiet) {
+        va_list args;
+        int hex = (TT_TOKEN_FMT_ASSERT_HEX == fmt_id);
+        token_start(TT_TOKEN_FAIL);
+        tt_putchar((char)fmt_id);
+        token_location(filename, lineno);
+        tt_putchar((char)(nargs + hex));
+        va_start(args, nargs);
+        while (nargs-- > 0)
+            token_put32((unsigned long)va_arg(args, long));
+        va_end(args);
+        if (hex)
+            token_put32(token_hex_width());
+    }
+}
+
+void tt_token_string(const char* str) {
+    if ((TT_OUTPUT_MODE_QUIET != f_ctx.output_mode) && !f_quiet) {
+        token_start(TT_TOKEN_STRING);
+        do
+            tt_putchar(*str);
+        while ('\0' != *str++);
+    }
+}
+
+void tt_token_diagnostic(tt_pgm_str_t filename, int lineno, int nargs, ...) {
+    if ((TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode) && !f_quiet) { // Only in verbose emit diagnostic messages.
+        va_list args;
+        token_start(TT_TOKEN_DIAG);
+        token_location(filename, lineno);
+        tt_putchar((char)nargs);
+        va_start(args, nargs);
+        while (nargs-- > 0)
+            token_put32((unsigned long)(long)va_arg(args, int));
+        va_end(args);
+    }
+}
+#endif
+
+// Print the description of the current test, a case from a table is described by the table only now that it is needed.
+static void print_test_desc(void) {
+    if (NULL == t_ctx.table)
+        tt_printf(TT_PSTR(TT_FMT_PSTR), t_ctx.test_desc);
+    else if (NULL != t_ctx.table->describe)
+        t_ctx.table->describe(t_ctx.table, t_ctx.case_index);
+    else
+        tt_printf(TT_PSTR("%s[%u]"), t_ctx.test_desc, t_ctx.case_index);
+}
+
+/** Print a failure diagnostic, a factor of the TT_ASSERT_xxx() macros. If msg is non-NULL, it is passed through
+    vprintf, together with any trailing arguments. */
+void tt_print_fail_message(tt_pgm_str_t filename, int lineno, tt_pgm_str_t msg, ...) {
+    va_list args;
+
+    if (f_quiet)
+        return;
+
+#ifdef TT_WANT_TOKENS
+    if (TT_OUTPUT_MODE_QUIET != f_ctx.output_mode) {		// Send the message as text.
+        tt_token_fail(filename, lineno, TT_TOKEN_FMT_TEXT, 0);
+        token_start(TT_TOKEN_STRING);
+        va_start(args, msg);
+        TT_VPRINTF(msg, args);
+        va_end(args);
+        tt_putchar('\0');
+    }
+    return;
+#endif
+    switch (f_ctx.output_mode) {
+	default:	 					// No output!
+		break;
+ 	case TT_OUTPUT_MODE_CONCISE:
+        tt_putchar('F');
+		break;
+	case TT_OUTPUT_MODE_DEFAULT:	 // Default & verbose both emit diagnostics for failures.
+		// Fall through...
+	case TT_OUTPUT_MODE_VERBOSE:
+        tt_printf(TT_PSTR("%s:%d: "), filename, lineno);
+        tt_printf(TT_PSTR("[%s:%d "), t_ctx.tf_filename, t_ctx.tf_lineno);
+        print_test_desc();
+        tt_printf(TT_PSTR("] FAIL: "));
+        va_start(args, msg);
+        TT_VPRINTF(msg, args);
+        va_end(args);
+		tt_printf(TT_PSTR("." TT_NEWLINE));		// A sentence must always end with a full stop.
+		break;
+    }
+}
+
+/* Start the output of a test, the leader in verbose mode, or the records that the decoder describes the test from, with the index
+	of a case of a table. */
+static void report_start(tt_pgm_str_t filename, int lineno, const tt_test_table_t* table, unsigned case_index) {
+#ifdef TT_WANT_TOKENS
+    if (TT_OUTPUT_MODE_QUIET != f_ctx.output_mode) {
+        token_start(TT_TOKEN_TEST);
+        token_location(filename, lineno);
+        if (NULL != table) {
+            token_start(TT_TOKEN_CASE);
+            token_put16(case_index);
+        }
+    }
+#else
+    (void)table;
+    (void)case_index;
+    if (TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode)
+        tt_printf(TT_PSTR("%s:%d: "), filename, lineno);
+#endif
+}
+
+static void report(tt_pgm_str_t msg, char concise) {
+#ifdef TT_WANT_TOKENS
+    if (TT_OUTPUT_MODE_QUIET != f_ctx.output_mode) {		// The decoder prints the result.
+        token_start(TT_TOKEN_RESULT);
+        tt_putchar(('.' == concise) ? TINY_TEST_SUCCESS : TINY_TEST_IGNORED);
+    }
+    return;
+#endif
+    switch (f_ctx.output_mode) {
+	default:	 					// No output!
+		break;
+ 	case TT_OUTPUT_MODE_CONCISE:	// Just print a single char.
+        tt_putchar(concise);
+		break;
+	case TT_OUTPUT_MODE_DEFAULT:	 // Default no output for success, ignored, only failures, which are handled by another output routine.
+		break;
+	case TT_OUTPUT_MODE_VERBOSE:
+        tt_printf(TT_PSTR("["));
+        print_test_desc();
+        tt_printf(TT_PSTR("]: %s" TT_NEWLINE), msg);
+		break;
+   }
+}
+
+/* Sharding. Each selected test is given to one shard, counting tests in the order that ttRunTests() runs them, so every shard must
+	run the same build with the same groupstr. Without test times the tests are dealt out in turn. With test times from a baseline
+	results file ttSetShard() first calls ttRunTests() to count the tests without running them, then gives each test, longest first,
+	to the shard with the least total time, so that the shards take about the same time. Tests not in the baseline take the mean. */
+#define SHARD_TIME_UNKNOWN (~0ULL)      // Time of a test that is not in the baseline.
+static int shard_selected(tt_pgm_str_t filename, tt_pgm_str_t desc) {
+    unsigned index = f_ctx.shard_test++;
+#ifdef TT_WANT_FILES
+    if (f_ctx.shard_sizing) {
+        const baseline_entry_t* e = find_baseline(filename, desc, 1);
+        if (index >= f_ctx.shard_alloc) {
+            unsigned alloc = (f_ctx.shard_alloc > 0) ? (f_ctx.shard_alloc * 2) : 256;
+            unsigned long long* times = (unsigned long long*)realloc(f_ctx.shard_times, alloc * sizeof(unsigned long long));
+            if (NULL == times) {		// Just deal the tests out.
+                f_ctx.shard_sizing = 0;
+                return 0;
+            }
+            f_ctx.shard_times = times;
+            f_ctx.shard_alloc = alloc;
+        }
+        f_ctx.shard_times[index] = (NULL != e) ? (e->elapsed / e->count) : SHARD_TIME_UNKNOWN;
+        return 0;
+    }
+    if (index < f_ctx.shard_count)
+        return f_ctx.shard_of[index] == f_ctx.shard;
+#endif
+    (void)filename; (void)desc;
+    return (int)(index % (unsigned)f_ctx.shards) == f_ctx.shard;
+}
+
+#ifdef TT_WANT_FILES
+typedef struct {
+    unsigned long long time;
+    unsigned index;
+} shard_job_t;
+
+static int shard_job_compare(const void* a, const void* b) {	// Longest first, then in order, so all shards agree.
+    const shard_job_t* ja = (const shard_job_t*)a;
+    const shard_job_t* jb = (const shard_job_t*)b;
+    if (ja->time != jb->time)
+        return (ja->time > jb->time) ? -1 : 1;
+    return (ja->index > jb->index) - (ja->index < jb->index);
+}
+
+static void shard_balance(void) {
+    unsigned i, count, known = 0U;
+    unsigned long long mean = 0ULL;
+    shard_job_t* jobs;
+    unsigned long long* loads;
+
+    f_ctx.shard_sizing = 1;
+    ttRunTests();
+    count = f_ctx.shard_sizing ? f_ctx.shard_test : 0U;
+    f_ctx.shard_sizing = 0;
+    f_ctx.shard_test = 0;
+    jobs = (shard_job_t*)malloc((count + 1) * sizeof(shard_job_t));
+    loads = (unsigned long long*)calloc((size_t)f_ctx.shards, sizeof(unsigned long long));
+    f_ctx.shard_of = (int*)malloc((count + 1) * sizeof(int));
+    if ((NULL != jobs) && (NULL != loads) && (NULL != f_ctx.shard_of)) {
+        for (i = 0; i < count; ++i) {
+            if (SHARD_TIME_UNKNOWN != f_ctx.shard_times[i]) {
+                mean += f_ctx.shard_times[i];
+                known += 1;
+            }
+        }
+        mean = (known > 0) ? (mean / known) : 1ULL;
+        for (i = 0; i < count; ++i) {
+            jobs[i].time = (SHARD_TIME_UNKNOWN != f_ctx.shard_times[i]) ? f_ctx.shard_times[i] : mean;
+            jobs[i].index = i;
+        }
+        qsort(jobs, count, sizeof(shard_job_t), shard_job_compare);
+        for (i = 0; i < count; ++i) {
+            int s, best = 0;
+            for (s = 1; s < f_ctx.shards; ++s) {
+                if (loads[s] < loads[best])
+                    best = s;
+            }
+            loads[best] += jobs[i].time + 1;	// Tests that take no time still count.
+            f_ctx.shard_of[jobs[i].index] = best;
+        }
+        f_ctx.shard_count = count;
+    }
+    else {
+        free(f_ctx.shard_of);
+        f_ctx.shard_of = NULL;
+    }
+    free(jobs);
+    free(loads);
+    free(f_ctx.shard_times);
+    f_ctx.shard_times = NULL;
+    f_ctx.shard_alloc = 0;
+}
+#endif
+
+void ttSetShard(int shard, int shards) {
+    f_ctx.shards = ((shards > 1) && (shard >= 1) && (shard <= shards)) ? shards : 0;
+    f_ctx.shard = shard - 1;
+    f_ctx.shard_test = 0;
+#ifdef TT_WANT_FILES
+    if (f_ctx.shards > 0) {
+        const baseline_entry_t* e;
+        for (e = f_ctx.baseline; (NULL != e) && !e->is_test; e = e->next)
+            ;
+        if (NULL != e)
+            shard_balance();
+    }
+#endif
+}
+
+/* Decide whether to run a test. If sharding then only tests given to this shard are selected, then they may be selected by whether
+	they failed in the last run. If running in parallel then each worker only gets every Nth selected test. */
+static int is_selected(tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc) {
+    if ((NULL != f_ctx.groupstr) && (NULL == strstr(desc, f_ctx.groupstr)))
+        return 0;
+    if ((f_ctx.shards > 0) && !shard_selected(filename, desc))
+        return 0;
+#ifdef TT_WANT_FILES
+    if (!last_failed_selected(filename, lineno, desc))
+        return 0;
+#endif
+    (void)lineno;
+    if (f_ctx.jobs > 0) {
+        int index = f_ctx.test_index++;
+        return ((index % f_ctx.jobs) == f_ctx.worker) && (index >= f_ctx.worker_resume);
+    }
+    return 1;
+}
+
+#ifdef TT_WANT_FORK
+static void worker_send_started(tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc, const tt_test_table_t* table, unsigned case_index);
+static void worker_send_result(int result);
+#endif
+
+#ifdef TT_HAVE_COVERAGE
+int ttCaptureCoverage(const char* dir) {
+    if (0 != mkdir(dir, 0777))
+        return -1;
+    f_ctx.coverage_dir = dir;
+    return 0;
+}
+
+// Dump the counters to the directory of a test, they are added to any that are already there.
+static void coverage_dump_test(unsigned long pid, unsigned test) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%lu-%u", f_ctx.coverage_dir, pid, test);
+    tt_coverage_dump(path);
+}
+
+// Dump the coverage of the test that has just run to its own directory, & add it to the list of tests.
+static void coverage_dump(void) {
+    char path[512];
+    char buf[TT_CASE_DESC_MAX];
+    FILE* fp;
+
+    coverage_dump_test(t_ctx.coverage_pid, t_ctx.coverage_test);
+    snprintf(path, sizeof(path), "%s/tests", f_ctx.coverage_dir);
+    fp = fopen(path, "a");
+    if (NULL != fp) {
+        fprintf(fp, "%lu-%u\t%s\t%d\t%s\n", t_ctx.coverage_pid, t_ctx.coverage_test, t_ctx.tf_filename, t_ctx.tf_lineno, 
+          case_desc(buf, t_ctx.test_desc, t_ctx.table, t_ctx.case_index));
+        fclose(fp);
+    }
+}
+
+/* The suite fixtures are covered by the first test of the suite that this process runs, so a change to them selects it. The counters
+	are reset before setup_once & not again before the test, & those of teardown_once are added to the directory of the test. */
+static void coverage_suite_start(void) {
+    if ((NULL != f_ctx.coverage_dir) && (SUITE_PENDING == f_ctx.suite_state)) {
+        tt_coverage_reset();
+        t_ctx.coverage_keep = 1;
+        f_ctx.suite_coverage = 1;
+        f_ctx.suite_coverage_pid = t_ctx.coverage_pid;
+        f_ctx.suite_coverage_test = t_ctx.coverage_test;
+    }
+}
+#endif
+
+/* Run setup, test & teardown and record the time taken, returns one of TINY_TEST_xxx. Ignored & failed tests are reported here, passed
+	tests are reported by the caller as they might still fail a time limit. */
+static int run_test(void (*test_func)(void)) {
+    int exc;
+#ifdef tt_clock
+    tt_clock_t start;
+#ifdef tt_cpu_clock
+    tt_clock_t cpu_start;
+#endif
+#endif
+
+    memset(&t_ctx.stats, 0, sizeof(t_ctx.stats));
+#ifdef tt_stack_bounds
+    stack_paint((char*)&exc);			// Not timed.
+#endif
+#ifdef TT_HAVE_COVERAGE
+    if ((NULL != f_ctx.coverage_dir) && !t_ctx.coverage_keep)
+        tt_coverage_reset();
+#endif
+#ifdef TT_WANT_PERF
+    perf_open();
+#endif
+#ifdef tt_clock
+    start = tt_clock();
+#ifdef tt_cpu_clock
+    cpu_start = tt_cpu_clock();
+#endif
+#endif
+#ifdef TT_HAVE_ALLOC
+    alloc_start();
+#endif
+#ifdef TT_WANT_PERF
+    perf_start();
+#endif
+
+    // Call the test, set flag on failure.
+    exc = setjmp(t_ctx.here);
+    if (TINY_TEST_SUCCESS == exc) { 	    // When setjmp is called normally it just returns 0.
+#ifdef tt_watchdog_start
+        if (t_ctx.test_timeout > 0)			// Watchdog covers setup & test, not teardown.
+            tt_watchdog_start(t_ctx.test_timeout);
+#endif
+        if (NULL != t_ctx.setup)			// Call fixture setup func.
+            t_ctx.setup();
+        test_func();
+    }
+#ifdef tt_watchdog_start
+    if (t_ctx.test_timeout > 0)
+        tt_watchdog_stop();
+#endif
+    if (TINY_TEST_IGNORED == exc) 		// This test has been flagged as IGNORED.
+        report("IGNORED", 'I');				// Handle output reporting.
+    else if (TINY_TEST_SUCCESS != exc) {	// We have a failure or a timeout.
+#ifdef tt_watchdog_start
+        if (TINY_TEST_TIMEOUT == exc) {
+#ifndef TT_WANT_TOKENS
+            if (TT_OUTPUT_MODE_CONCISE == f_ctx.output_mode)
+                tt_putchar('T');
+            else
+#endif
+                tt_print_fail_message(t_ctx.tf_filename, t_ctx.tf_lineno, TT_PSTR("Timed out after %lums"), t_ctx.test_timeout);
+        }
+#endif
+        if (NULL != t_ctx.dump) 			// Call dump function if non-NULL.
+            t_ctx.dump();
+    }
+
+    if (NULL != t_ctx.teardown)
+        t_ctx.teardown();
+#ifdef TT_WANT_PERF
+    perf_stop();
+#endif
+#ifdef TT_HAVE_ALLOC
+    alloc_stop();
+#endif
+
+#ifdef tt_clock
+    t_ctx.stats.elapsed = tt_clock() - start;
+#ifdef tt_cpu_clock
+    t_ctx.stats.cpu = tt_cpu_clock() - cpu_start;
+#endif
+#endif
+#ifdef tt_stack_bounds
+    t_ctx.stats.stack_peak = stack_scan();
+#endif
+#ifdef TT_HAVE_COVERAGE
+    if (NULL != f_ctx.coverage_dir)
+        coverage_dump();
+#endif
+    return exc;
+}
+
+#ifdef TT_WANT_FORK
+static int run_test_isolated(void (*test_func)(void));
+#endif
+
+#ifdef TT_WANT_TOKENS
+// Send the measurements of a test, a byte with a TT_TOKEN_STAT_xxx bit for each one that follows.
+static void token_stats(const test_stats_t* stats) {
+    unsigned flags = 0;
+#ifdef tt_clock
+    flags |= TT_TOKEN_STAT_TIME;
+#ifdef tt_cpu_clock
+    flags |= TT_TOKEN_STAT_CPU;
+#endif
+#endif
+#ifdef TT_HAVE_ALLOC
+    flags |= TT_TOKEN_STAT_ALLOC;
+#endif
+#ifdef tt_stack_bounds
+    flags |= TT_TOKEN_STAT_STACK;
+#endif
+    token_start(TT_TOKEN_STATS);
+    tt_putchar((char)flags);
+#ifdef tt_clock
+    token_put32((unsigned long)stats->elapsed);
+#ifdef tt_cpu_clock
+    token_put32((unsigned long)stats->cpu);
+#endif
+#endif
+#ifdef TT_HAVE_ALLOC
+    token_put32(stats->allocs);
+    token_put32(stats->alloc_bytes);
+    token_put32(stats->alloc_peak);
+#endif
+#ifdef tt_stack_bounds
+    token_put32(stats->stack_peak);
+#endif
+    (void)stats;
+}
+#endif
+
+/* Run a test with the fixtures & timeout already in t_ctx, apply the checks on its measurements and print the results. Returns one of
+	TINY_TEST_xxx, the caller counts & records it. The caller calls report_start() first, before setup_once, so that a failure of
+	setup_once is reported against this test. */
+static int run_test_and_report(void (*test_func)(void), tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc) {
+    int exc;
+
+    // Setup the test context.
+    t_ctx.tf_filename = filename;
+    t_ctx.tf_lineno = lineno;
+    t_ctx.test_desc = desc;
+
+    if (TINY_TEST_SUCCESS != t_ctx.suite_result) {	// Not run as the suite setup failed or was ignored.
+        memset(&t_ctx.stats, 0, sizeof(t_ctx.stats));
+        exc = t_ctx.suite_result;
+        if (TINY_TEST_IGNORED == exc)
+            report("IGNORED", 'I');
+        else {
+            tt_print_fail_message(filename, lineno, TT_PSTR("Suite setup failed"));
+            exc = TINY_TEST_FAIL;
+        }
+#ifdef TT_HAVE_COVERAGE
+        if (t_ctx.coverage_keep)		// The first test of the suite still covers setup_once.
+            coverage_dump();
+#endif
+    }
+    else
+#ifdef TT_WANT_FORK
+        exc = f_ctx.isolate ? run_test_isolated(test_func) : run_test(test_func);
+#else
+        exc = run_test(test_func);
+#endif
+
+#ifdef tt_clock
+    if ((f_ctx.time_limit > 0) && (t_ctx.stats.elapsed > f_ctx.time_limit) && (TINY_TEST_SUCCESS == exc)) { // Passed, but too slow.
+        tt_print_fail_message(filename, lineno, TT_PSTR("Time limit of %lums exceeded"), (unsigned long)(f_ctx.time_limit / 1000));
+        exc = TINY_TEST_FAIL;
+    }
+#endif
+#ifdef TT_HAVE_ALLOC
+    if ((t_ctx.stats.leaks > 0) && (TINY_TEST_SUCCESS == exc)) { // Passed, but did not free everything.
+        tt_print_fail_message(filename, lineno, TT_PSTR("Leaked %lu bytes in %lu blocks"), t_ctx.stats.leak_bytes, t_ctx.stats.leaks);
+        exc = TINY_TEST_FAIL;
+    }
+#endif
+#ifdef tt_stack_bounds
+    if ((f_ctx.stack_limit > 0) && (t_ctx.stats.stack_peak > f_ctx.stack_limit) && (TINY_TEST_SUCCESS == exc)) { // Passed, but too deep.
+        tt_print_fail_message(filename, lineno, TT_PSTR("Stack use of %lu bytes exceeds limit of %lu"), t_ctx.stats.stack_peak, f_ctx.stack_limit);
+        exc = TINY_TEST_FAIL;
+    }
+#endif
+    if (TINY_TEST_SUCCESS == exc)
+        report("OK", '.');
+#if defined(tt_clock) || defined(TT_HAVE_ALLOC) || defined(tt_stack_bounds) || defined(TT_WANT_PERF)
+#ifdef TT_WANT_TOKENS
+    if (TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode)		// The decoder prints the measurements, but not the perf counters.
+        token_stats(&t_ctx.stats);
+#else
+    if (TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode) {
+        tt_printf(TT_PSTR("["));
+        print_test_desc();
+        tt_printf(TT_PSTR("]:"));
+#ifdef tt_clock
+        tt_printf(TT_PSTR(" time "));
+        print_time(t_ctx.stats.elapsed);
+#ifdef tt_cpu_clock
+        tt_printf(TT_PSTR(", cpu "));
+        print_time(t_ctx.stats.cpu);
+#endif
+#endif
+#ifdef TT_HAVE_ALLOC
+#ifdef tt_clock
+        tt_printf(TT_PSTR(","));
+#endif
+        tt_printf(TT_PSTR(" allocs %lu, bytes %lu, peak %lu"), t_ctx.stats.allocs, t_ctx.stats.alloc_bytes, t_ctx.stats.alloc_peak);
+#endif
+#ifdef tt_stack_bounds
+#if defined(tt_clock) || defined(TT_HAVE_ALLOC)
+        tt_printf(TT_PSTR(","));
+#endif
+        tt_printf(TT_PSTR(" stack %lu"), t_ctx.stats.stack_peak);
+#endif
+#ifdef TT_WANT_PERF
+        {
+            int i;
+            for (i = 0; i < PERF_NUM_EVENTS; ++i) {
+                if (t_ctx.stats.perf_valid & (1U << i))
+                    tt_printf(TT_PSTR(", %s %llu"), PERF_EVENTS[i].name, t_ctx.stats.perf[i]);
+            }
+        }
+#endif
+        tt_printf(TT_PSTR(TT_NEWLINE));
+    }
+#endif
+#endif
+    return exc;
+}
+
+static void count_result(int result) {
+    if (TINY_TEST_SUCCESS == result)
+        f_ctx.pass_count += 1;
+    else if (TINY_TEST_IGNORED == result)
+        f_ctx.ignore_count += 1;
+    else if (TINY_TEST_TIMEOUT == result)
+        f_ctx.timeout_count += 1;
+    else
+        f_ctx.fail_count += 1;
+}
+
+#ifdef TT_WANT_THREADS
+static void pool_add(void (*test_func)(void), tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc, int serial, 
+  const tt_test_table_t* table, unsigned case_index);
+#endif
+
+#ifdef TT_WANT_THREADS
+static void pool_end_suite(void);
+#endif
+
+void ttEndSuite(void) {
+#ifdef TT_WANT_THREADS
+    if (f_ctx.collecting)				// The thread pool calls teardown_once after the last test.
+        pool_end_suite();
+    else
+#endif
+    if ((SUITE_STARTED == f_ctx.suite_state) && (TINY_TEST_SUCCESS == f_ctx.suite_result)) {
+#ifdef TT_HAVE_COVERAGE
+        if (f_ctx.suite_coverage)
+            tt_coverage_reset();
+#endif
+        if (TINY_TEST_SUCCESS != run_suite_fixture(f_ctx.teardown_once, t_ctx.tf_filename, t_ctx.tf_lineno, t_ctx.test_desc))
+            f_ctx.fail_count += 1;		// The last test has been recorded, so just count it.
+#ifdef TT_HAVE_COVERAGE
+        if (f_ctx.suite_coverage)
+            coverage_dump_test(f_ctx.suite_coverage_pid, f_ctx.suite_coverage_test);
+#endif
+    }
+#ifdef TT_HAVE_COVERAGE
+    f_ctx.suite_coverage = 0;
+#endif
+    f_ctx.setup_once = f_ctx.teardown_once = NULL;
+    f_ctx.suite_state = SUITE_NONE;
+    f_ctx.suite_result = TINY_TEST_SUCCESS;
+}
+
+void ttSetNextSerial(void) {
+    f_ctx.next_serial = 1;
+}
+
+void ttRunTest(void (*test_func)(void), tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc) {
+    int serial = f_ctx.next_serial;
+    const tt_test_table_t* table = f_ctx.next_table;
+    unsigned case_index = f_ctx.next_case;
+    char buf[TT_CASE_DESC_MAX];
+#ifdef tt_watchdog_start
+    t_ctx.test_timeout = f_ctx.have_next_timeout ? f_ctx.next_timeout : f_ctx.timeout;
+    f_ctx.have_next_timeout = 0;		// Overrides only apply to one test, even if it is not selected.
+#endif
+    f_ctx.next_serial = 0;
+    f_ctx.next_table = NULL;
+#ifdef TT_WANT_REGISTRY
+    if ((f_ctx.registry_select >= 0) && !f_ctx.next_registered)	// Only the selected registered test is run.
+        return;
+    f_ctx.next_registered = 0;
+#endif
+    if (!f_ctx.bench_mode && is_selected(filename, lineno, case_desc(buf, desc, table, case_index))) { // Decide whether to run this test...
+        int exc;
+
+#ifdef TT_WANT_THREADS
+        if (f_ctx.collecting) {			// Just add it to the list for the thread pool.
+            pool_add(test_func, filename, lineno, desc, serial, table, case_index);
+            return;
+        }
+#endif
+        (void)serial;
+#ifdef TT_WANT_FORK
+        if (f_ctx.jobs > 0)				// Running in a worker, so the parent can fail the test if the worker dies in it.
+            worker_send_started(filename, lineno, desc, table, case_index);
+#endif
+#ifdef TT_HAVE_COVERAGE
+        t_ctx.coverage_pid = (unsigned long)getpid();	// Unique, even if the test runs in a child or in a parallel worker.
+        t_ctx.coverage_test = f_ctx.coverage_count++;
+        coverage_suite_start();
+#endif
+        report_start(filename, lineno, table, case_index);
+        t_ctx.suite_result = suite_start(filename, lineno, desc);
+        t_ctx.table = table;
+        t_ctx.case_index = case_index;
+        t_ctx.setup = f_ctx.setup;
+        t_ctx.teardown = f_ctx.teardown;
+        t_ctx.dump = f_ctx.dump;
+        exc = run_test_and_report(test_func, filename, lineno, desc);
+#ifdef TT_HAVE_COVERAGE
+        t_ctx.coverage_keep = 0;
+#endif
+        count_result(exc);
+        if (0 == f_ctx.jobs)            // Parallel workers leave the parent to record results.
+            record_result(filename, lineno, desc, table, case_index, exc, &t_ctx.stats);
+#ifdef TT_WANT_FORK
+        if (f_ctx.jobs > 0)				// Running in a worker, send the result & output back to the parent.
+            worker_send_result(exc);
+#endif
+    }
+}
+
+// Test function for a case of a table, the table & index are in the test context.
+static void run_table_case(void) {
+    t_ctx.table->run(t_ctx.table, t_ctx.case_index);
+}
+
+void ttRunTestTable(const tt_test_table_t* table, tt_pgm_str_t filename) {
+    int serial = f_ctx.next_serial;
+#ifdef tt_watchdog_start
+    int have_next_timeout = f_ctx.have_next_timeout;
+#endif
+    unsigned i;
+    for (i = 0; i < table->count; ++i) {
+        int lineno = table->lineno;
+        if (0 == lineno)
+            tt_pgm_read_mem(&lineno, (const char*)table->cases + (size_t)i * table->size, sizeof(lineno));
+        f_ctx.next_serial = serial;		// These apply to all the cases.
+#ifdef tt_watchdog_start
+        f_ctx.have_next_timeout = have_next_timeout;
+#endif
+        f_ctx.next_table = table;
+        f_ctx.next_case = i;
+        ttRunTest(run_table_case, filename, lineno, table->name);
+    }
+    f_ctx.next_serial = 0;
+#ifdef tt_watchdog_start
+    f_ctx.have_next_timeout = 0;
+#endif
+}
+
+#ifdef TT_WANT_REGISTRY
+/* The linker makes these symbols at the start & end of the section of test descriptors. They are weak so that a program with no
+	registered tests still links. */
+extern const tt_test_desc_t __start_tt_tests[] __attribute__((weak));
+extern const tt_test_desc_t __stop_tt_tests[] __attribute__((weak));
+
+unsigned ttRegisteredTestCount(void) {
+    return (NULL == __start_tt_tests) ? 0U : (unsigned)(__stop_tt_tests - __start_tt_tests);
+}
+
+int ttSelectRegisteredTest(int index) {
+    if ((index >= 0) && ((unsigned)index >= ttRegisteredTestCount()))
+        return -1;
+    f_ctx.registry_select = (index < 0) ? -1 : index;
+    return 0;
+}
+
+void ttRunRegisteredTests(void) {
+    unsigned i, count = ttRegisteredTestCount();
+    tt_test_desc_t d;
+
+    for (i = 0; i < count; ++i) {
+        if ((f_ctx.registry_select >= 0) && (i != (unsigned)f_ctx.registry_select))
+            continue;
+        tt_pgm_read_mem(&d, &__start_tt_tests[i], sizeof(d));
+        f_ctx.next_registered = 1;
+        ttRunTest(d.test_func, *d.filename, d.lineno, d.desc);
+    }
+}
+
+void ttListRegisteredTests(void) {
+    unsigned i, count = ttRegisteredTestCount();
+    tt_test_desc_t d;
+
+    for (i = 0; i < count; ++i) {
+        tt_pgm_read_mem(&d, &__start_tt_tests[i], sizeof(d));
+        tt_printf(TT_PSTR("%4u " TT_FMT_PSTR ":%d: " TT_FMT_PSTR "\n"), i, *d.filename, d.lineno, d.desc);
+    }
+}
+
+// Programs that only have registered tests need not write ttRunTests().
+__attribute__((weak)) void ttRunTests(void) {
+    ttRunRegisteredTests();
+}
+#endif
+
+#ifndef __GNUC__
+// Escape a pointer so that the compiler must assume the memory it points to is used.
+static const void* volatile f_bench_sink;
+void tt_bench_escape(const void* p) {
+    f_bench_sink = p;
+}
+#endif
+
+#ifdef tt_clock
+void ttSetBenchMode(int enable) {
+    f_ctx.bench_mode = enable;
+}
+
+// Run a benchmark once with the given number of iterations, return elapsed time in microseconds.
+static tt_clock_t bench_sample(void (*bench_func)(tt_bench_t*), unsigned long iterations) {
+    tt_bench_t b;
+    tt_clock_t start;
+
+    b.iterations = iterations;
+    start = tt_clock();
+    bench_func(&b);
+    return tt_clock() - start;
+}
+
+static void sort_samples(unsigned long long* v, int n) {
+    int i, j;
+    for (i = 1; i < n; ++i) {
+        unsigned long long x = v[i];
+        for (j = i; (j > 0) && (v[j-1] > x); --j)
+            v[j] = v[j-1];
+        v[j] = x;
+    }
+}
+
+/* Measure a benchmark. First find the number of iterations that takes about TT_BENCH_SAMPLE_TIME, then run warmup samples, then
+	take samples of the time per iteration in picoseconds. Results are the median, minimum and median absolute deviation. */
+static void bench_measure(void (*bench_func)(tt_bench_t*), bench_result_t* res) {
+    unsigned long long samples[TT_BENCH_SAMPLES];
+    unsigned long n = 1;
+    int i;
+
+    for (;;) {		// Calibrate, growing the iteration count by at most 100 times per step.
+        tt_clock_t elapsed = bench_sample(bench_func, n);
+        unsigned long next;
+        if ((elapsed >= TT_BENCH_SAMPLE_TIME) || (n >= TT_BENCH_MAX_ITERATIONS))
+            break;
+        next = (elapsed > 0) ? (unsigned long)((unsigned long long)n * TT_BENCH_SAMPLE_TIME * 12 / 10 / elapsed) : n * 100;
+        if (next > n * 100)
+            next = n * 100;
+        if (next <= n)
+            next = n * 2;
+        n = (next > TT_BENCH_MAX_ITERATIONS) ? TT_BENCH_MAX_ITERATIONS : next;
+    }
+
+    for (i = 0; i < TT_BENCH_WARMUPS; ++i)
+        bench_sample(bench_func, n);
+    for (i = 0; i < TT_BENCH_SAMPLES; ++i)
+        samples[i] = (unsigned long long)bench_sample(bench_func, n) * 1000000ULL / n;
+
+    sort_samples(samples, TT_BENCH_SAMPLES);
+    res->iterations = n;
+    res->median = samples[TT_BENCH_SAMPLES / 2];
+    res->minimum = samples[0];
+    for (i = 0; i < TT_BENCH_SAMPLES; ++i)		// Now get absolute deviations from the median.
+        samples[i] = (samples[i] > res->median) ? (samples[i] - res->median) : (res->median - samples[i]);
+    sort_samples(samples, TT_BENCH_SAMPLES);
+    res->mad = samples[TT_BENCH_SAMPLES / 2];
+}
+
+#ifdef TT_WANT_FILES
+/* A benchmark has regressed if its median is slower than the baseline by more than the threshold percentage, and the difference
+	is also large compared with the noise, taken as 3 times the sum of the median absolute deviations of both measurements. */
+static int is_regression(const bench_result_t* res, const baseline_entry_t* base) {
+    return (NULL != base) && (res->median * 100 > base->median * (100 + f_ctx.threshold)) &&
+      (res->median - base->median > 3 * (res->mad + base->mad));
+}
+#endif
+
+void ttRunBench(void (*bench_func)(tt_bench_t*), tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc) {
+    if (f_ctx.bench_mode && is_selected(filename, lineno, desc)) {
+        int exc = suite_start(filename, lineno, desc);
+
+        t_ctx.tf_filename = filename;
+        t_ctx.tf_lineno = lineno;
+        t_ctx.test_desc = desc;
+
+        if (TINY_TEST_SUCCESS != exc) {		// Not run as the suite setup failed or was ignored.
+            if (TINY_TEST_IGNORED == exc) {
+                report("IGNORED", 'I');
+                f_ctx.ignore_count += 1;
+            }
+            else {
+                tt_print_fail_message(filename, lineno, TT_PSTR("Suite setup failed"));
+                f_ctx.fail_count += 1;
+            }
+            return;
+        }
+        exc = setjmp(t_ctx.here);
+        if (TINY_TEST_SUCCESS == exc) {
+            bench_result_t res;
+#ifdef TT_WANT_FILES
+            const baseline_entry_t* base = find_baseline(filename, desc, 0);
+            int retry;
+#endif
+
+            if (NULL != f_ctx.setup)
+                f_ctx.setup();
+            bench_measure(bench_func, &res);
+#ifdef TT_WANT_FILES
+            for (retry = 0; (retry < TT_BENCH_RETRIES) && is_regression(&res, base); ++retry) { // Remeasure in case it was just noise.
+                bench_result_t again;
+                bench_measure(bench_func, &again);
+                if (again.median < res.median)
+                    res = again;
+            }
+            if (NULL != f_ctx.results_file)
+                fprintf(f_ctx.results_file, "bench\t%s\t%s\t%llu\t%llu\t%llu\t%lu\n", filename, desc, res.median, res.mad, res.minimum, res.iterations);
+#endif
+#ifdef TT_WANT_TOKENS
+            if (TT_OUTPUT_MODE_QUIET != f_ctx.output_mode) {		// The decoder prints the results.
+                token_start(TT_TOKEN_BENCH);
+                token_location(filename, lineno);
+                token_put64(res.median);
+                token_put64(res.minimum);
+                token_put64(res.mad);
+                token_put32(res.iterations);
+                token_put16(TT_BENCH_SAMPLES);
+#ifdef TT_WANT_FILES
+                token_put64((NULL != base) ? base->median : 0ULL);
+#else
+                token_put64(0ULL);
+#endif
+            }
+#else
+            if (TT_OUTPUT_MODE_QUIET != f_ctx.output_mode) {		// Benchmark results are always printed, unless quiet.
+                tt_printf(TT_PSTR("%s:%d: [%s]: "), filename, lineno, desc);
+                print_milli(res.median);
+                tt_printf(TT_PSTR("ns/op median, min "));
+                print_milli(res.minimum);
+                tt_printf(TT_PSTR(", MAD "));
+                print_milli(res.mad);
+                tt_printf(TT_PSTR(", %lu iterations x %d samples"), res.iterations, TT_BENCH_SAMPLES);
+#ifdef TT_WANT_FILES
+                if (NULL != base) {
+                    tt_printf(TT_PSTR(", baseline "));
+                    print_milli(base->median);
+                }
+#endif
+                tt_printf(TT_PSTR(TT_NEWLINE));
+            }
+#endif
+#ifdef TT_WANT_FILES
+            if (is_regression(&res, base)) {
+                tt_print_fail_message(filename, lineno, TT_PSTR("Benchmark regression, median %llups/op, baseline %llups/op, threshold %d%%"),
+                  res.median, base->median, f_ctx.threshold);
+                tt_abort(TINY_TEST_FAIL);
+            }
+#endif
+            f_ctx.pass_count += 1;
+        }
+        else if (TINY_TEST_IGNORED == exc) {
+            report("IGNORED", 'I');
+            f_ctx.ignore_count += 1;
+        }
+        else {
+            if (NULL != f_ctx.dump)
+                f_ctx.dump();
+            f_ctx.fail_count += 1;
+        }
+
+        if (NULL != f_ctx.teardown)
+            f_ctx.teardown();
+    }
+}
+#endif
+
+#ifdef tt_cycles
+/* Budget assertions. The loop in TT_ASSERT_MAX_CYCLES() calls tt_budget_next() before each run of the block, it records the time since 
+	the last call then starts the next run. After TT_BUDGET_REPEATS runs the median less the overhead of an empty block is checked 
+	against the budget. The overhead is measured by an empty loop the first time on each thread. */
+static unsigned long budget_read(int kind) {
+#ifdef tt_ns
+    if (TT_BUDGET_NS == kind)
+        return tt_ns();
+#endif
+    (void)kind;
+    return tt_cycles();
+}
+
+static unsigned long budget_median(unsigned long* v, int n) {
+    int i, j;
+    for (i = 1; i < n; ++i) {
+        unsigned long x = v[i];
+        for (j = i; (j > 0) && (v[j-1] > x); --j)
+            v[j] = v[j-1];
+        v[j] = x;
+    }
+    return v[n / 2];
+}
+
+// Record the time of the run that has ended & start the next, returns zero when all the runs are done.
+static int budget_step(budget_t* b) {
+    unsigned long now = budget_read(b->kind);
+
+    if (b->n > 0)
+        b->samples[b->n - 1] = (now - b->start) & TT_CYCLES_MASK;
+    if (b->n < TT_BUDGET_REPEATS) {
+        b->n += 1;
+        b->start = budget_read(b->kind);
+        return 1;
+    }
+    return 0;
+}
+
+void tt_budget_start(int kind) {
+    memset(&t_ctx.budget, 0, sizeof(t_ctx.budget));
+    t_ctx.budget.kind = kind;
+}
+
+int tt_budget_next(unsigned long budget, tt_pgm_str_t filename, int lineno) {
+    static TT_THREAD_LOCAL unsigned long overhead[2];
+    static TT_THREAD_LOCAL int have_overhead[2];
+    int kind = t_ctx.budget.kind;
+    unsigned long median;
+
+    if (budget_step(&t_ctx.budget))
+        return 1;
+    median = budget_median(t_ctx.budget.samples, TT_BUDGET_REPEATS);
+    if (!have_overhead[kind]) {
+        budget_t empty;
+        memset(&empty, 0, sizeof(empty));
+        empty.kind = kind;
+        while (budget_step(&empty))
+            ;
+        overhead[kind] = budget_median(empty.samples, TT_BUDGET_REPEATS);
+        have_overhead[kind] = 1;
+    }
+    median = (median > overhead[kind]) ? (median - overhead[kind]) : 0UL;
+    if (median > budget) {
+        tt_print_fail_message(filename, lineno, (TT_BUDGET_NS == kind) ? TT_PSTR("Expected <= %lu ns, median of %d runs %lu ns") : 
+          TT_PSTR("Expected <= %lu cycles, median of %d runs %lu cycles"), budget, TT_BUDGET_REPEATS, median);
+        tt_abort(TINY_TEST_FAIL);
+    }
+    return 0;
+}
+#endif
+
+#ifdef TT_WANT_FORK
+/* Parallel test running. Each worker is a forked copy of the process that runs ttRunTests() and picks out every Nth selected test.
+	The output of the worker is captured in a temporary file, and after each test it is sent to the parent down a pipe,
+	prefixed by a record holding the test index & result. The parent reads the results in test order, so the output is the
+	same as a serial run regardless of how the workers are scheduled. A worker also sends a record with the test details before 
+	each test, so that the parent can record the test as failed if the worker dies in it, & a last record when it has run all of its 
+	tests, so the parent knows that a worker that stops without one has died, even if it exited with status zero. */
+enum { WORKER_STARTED, WORKER_RESULT, WORKER_DONE };    // Kinds of worker record.
+typedef struct {
+    int kind;           // One of WORKER_xxx.
+    int index;          // Index of test in selected tests.
+    int result;         // One of TINY_TEST_xxx.
+    tt_pgm_str_t filename;  // Test details, pointers are valid in the parent as it is the same program.
+    int lineno;
+    tt_pgm_str_t desc;
+    const tt_test_table_t* table;
+    unsigned case_index;
+    test_stats_t stats; // Measurements made on the test.
+    unsigned len;       // Length of the captured output that follows.
+} worker_record_t;
+
+static int write_all(int fd, const void* buf, size_t len) {
+    const char* p = (const char*)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (EINTR == errno)
+                continue;
+            return 0;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+// Returns non-zero if all len bytes were read, zero on end of file or error.
+static int read_all(int fd, void* buf, size_t len) {
+    char* p = (char*)buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0) {
+            if (EINTR == errno)
+                continue;
+            return 0;
+        }
+        if (0 == n)
+            return 0;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+static void worker_send_started(tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc, const tt_test_table_t* table, unsigned case_index) {
+    worker_record_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.kind = WORKER_STARTED;
+    rec.index = f_ctx.test_index - 1;
+    rec.filename = filename;
+    rec.lineno = lineno;
+    rec.desc = desc;
+    rec.table = table;
+    rec.case_index = case_index;
+    write_all(f_ctx.result_fd, &rec, sizeof(rec));
+}
+
+static void worker_send_result(int result) {
+    worker_record_t rec;
+    char buf[256];
+    off_t len;
+
+    fflush(stdout);
+    len = lseek(STDOUT_FILENO, 0, SEEK_CUR);        // Stdout is the capture file, so its size is the output of this test.
+    rec.kind = WORKER_RESULT;
+    rec.index = f_ctx.test_index - 1;
+    rec.result = result;
+    rec.filename = t_ctx.tf_filename;
+    rec.lineno = t_ctx.tf_lineno;
+    rec.desc = t_ctx.test_desc;
+    rec.table = t_ctx.table;
+    rec.case_index = t_ctx.case_index;
+    rec.stats = t_ctx.stats;
+    rec.len = (len > 0) ? (unsigned)len : 0U;
+    write_all(f_ctx.result_fd, &rec, sizeof(rec));
+
+    lseek(STDOUT_FILENO, 0, SEEK_SET);
+    while (len > 0) {
+        ssize_t n = read(STDOUT_FILENO, buf, ((size_t)len < sizeof(buf)) ? (size_t)len : sizeof(buf));
+        if (n <= 0)
+            break;
+        write_all(f_ctx.result_fd, buf, (size_t)n);
+        len -= n;
+    }
+    while (len-- > 0)                               // Keep the stream in sync even if the capture file could not be read.
+        write_all(f_ctx.result_fd, "?", 1);
+    if (0 != ftruncate(STDOUT_FILENO, 0)) {}
+    lseek(STDOUT_FILENO, 0, SEEK_SET);
+}
+
+static void worker_run(int worker, int jobs, int resume, int fd) {
+    FILE* capture = tmpfile();
+    worker_record_t rec;
+    if ((NULL == capture) || (dup2(fileno(capture), STDOUT_FILENO) < 0))
+        _exit(2);
+    f_ctx.jobs = jobs;
+    f_ctx.worker = worker;
+    f_ctx.worker_resume = resume;
+    f_ctx.result_fd = fd;
+    ttRunTests();
+    memset(&rec, 0, sizeof(rec));
+    rec.kind = WORKER_DONE;
+    write_all(fd, &rec, sizeof(rec));
+    close(fd);
+    _exit(0);
+}
+
+/* Flush the streams that we write before forking, else the child has a copy of anything buffered, which it writes again if it ends
+	through exit(). */
+static void flush_before_fork(void) {
+    fflush(stdout);
+#ifdef TT_WANT_FILES
+    if (NULL != f_ctx.results_file)
+        fflush(f_ctx.results_file);
+#endif
+}
+
+// Fork worker w to run its tests from index resume, returns zero if it could not be started.
+static int worker_start(int w, int jobs, int resume, pid_t* pids, int* fds) {
+    int p[2];
+    fds[w] = -1;
+    pids[w] = -1;
+    if (0 != pipe(p)) {
+        tt_printf(TT_PSTR("Failed to create pipe for worker %d." TT_NEWLINE), w);
+        return 0;
+    }
+    flush_before_fork();
+    pids[w] = fork();
+    if (0 == pids[w]) {				// Child, close the read ends of pipes & run tests.
+        int i;
+        for (i = 0; i < jobs; ++i) {
+            if (fds[i] >= 0)
+                close(fds[i]);
+        }
+        close(p[0]);
+        worker_run(w, jobs, resume, p[1]);
+    }
+    close(p[1]);
+    if (pids[w] < 0) {
+        tt_printf(TT_PSTR("Failed to start worker %d." TT_NEWLINE), w);
+        close(p[0]);
+        return 0;
+    }
+    fds[w] = p[0];
+    return 1;
+}
+
+// Copy the output of a test from a worker to our output.
+static int copy_output(int fd, unsigned len) {
+    char buf[256];
+    while (len > 0) {
+        unsigned n = (len < sizeof(buf)) ? len : (unsigned)sizeof(buf);
+        unsigned i;
+        if (!read_all(fd, buf, n))
+            return 0;
+        for (i = 0; i < n; ++i)
+            tt_putchar(buf[i]);
+        len -= n;
+    }
+    return 1;
+}
+
+/* Crash isolation. The test is run in a child forked from this process, which has already run all of the program's
+	initialisation, so each test starts from the same state without paying for it again, and pages are only copied if a test writes
+	to them. The child sends back the result & measurements down a pipe. If the test crashes, hangs in exit() or calls exit() itself
+	then no result arrives and the test is failed with the reason. Output from the child goes straight to our stdout, which
+	is unbuffered in the child so that nothing is lost in a crash. */
+typedef struct {
+    int result;
+    test_stats_t stats;
+} isolated_record_t;
+
+void ttSetIsolation(int enable) {
+    f_ctx.isolate = enable;
+}
+
+static const char* signal_name(int sig) {
+    switch (sig) {
+    case SIGSEGV: return "SIGSEGV";
+    case SIGABRT: return "SIGABRT";
+    case SIGFPE:  return "SIGFPE";
+    case SIGILL:  return "SIGILL";
+    case SIGBUS:  return "SIGBUS";
+    case SIGKILL: return "SIGKILL";
+    case SIGTERM: return "SIGTERM";
+    case SIGALRM: return "SIGALRM";
+    case SIGPIPE: return "SIGPIPE";
+    case SIGTRAP: return "SIGTRAP";
+    default:      return NULL;
+    }
+}
+
+// Fail the test in t_ctx with the reason that the process running it ended, from the status given by waitpid().
+static void fail_exit_status(int status) {
+    if (WIFSIGNALED(status)) {
+        const char* name = signal_name(WTERMSIG(status));
+        if (NULL != name)
+            tt_print_fail_message(t_ctx.tf_filename, t_ctx.tf_lineno, TT_PSTR("Crashed with signal %s"), name);
+        else
+            tt_print_fail_message(t_ctx.tf_filename, t_ctx.tf_lineno, TT_PSTR("Crashed with signal %d"), WTERMSIG(status));
+    }
+    else if (WIFEXITED(status))
+        tt_print_fail_message(t_ctx.tf_filename, t_ctx.tf_lineno, TT_PSTR("Exited with status %d"), WEXITSTATUS(status));
+    else
+        tt_print_fail_message(t_ctx.tf_filename, t_ctx.tf_lineno, TT_PSTR("Exited without a result"));
+}
+
+static int run_test_isolated(void (*test_func)(void)) {
+    isolated_record_t rec;
+    int p[2];
+    int status;
+    int got_result;
+    pid_t pid;
+#ifdef tt_clock
+    tt_clock_t start = tt_clock();
+#endif
+
+    flush_before_fork();
+#ifdef TT_HAVE_COVERAGE
+    if (t_ctx.coverage_keep) {			// The child may not inherit the counters of setup_once, so dump them here.
+        coverage_dump_test(t_ctx.coverage_pid, t_ctx.coverage_test);
+        t_ctx.coverage_keep = 0;
+    }
+#endif
+    if (0 != pipe(p))
+        return run_test(test_func);		// Can't isolate, so just run it.
+    pid = fork();
+    if (pid < 0) {
+        close(p[0]);
+        close(p[1]);
+        return run_test(test_func);
+    }
+    if (0 == pid) {						// Child, run the test & send the result.
+        close(p[0]);
+        setvbuf(stdout, NULL, _IONBF, 0);
+        rec.result = run_test(test_func);
+        rec.stats = t_ctx.stats;
+        write_all(p[1], &rec, sizeof(rec));
+        _exit(0);
+    }
+
+    close(p[1]);
+    got_result = read_all(p[0], &rec, sizeof(rec));
+    close(p[0]);
+    while ((waitpid(pid, &status, 0) < 0) && (EINTR == errno))
+        ;
+    if (got_result) {
+        t_ctx.stats = rec.stats;
+        return rec.result;
+    }
+
+    memset(&t_ctx.stats, 0, sizeof(t_ctx.stats));
+#ifdef tt_clock
+    t_ctx.stats.elapsed = tt_clock() - start;		// Only wall time is known for a crashed test.
+#endif
+    fail_exit_status(status);
+    return TINY_TEST_FAIL;
+}
+
+void ttRunTestsParallel(int jobs) {
+    pid_t* pids;
+    int* fds;
+    int w, index, alive, resume, retry;
+
+    if (jobs <= 1) {
+        ttRunTests();
+        return;
+    }
+    pids = (pid_t*)malloc(jobs * sizeof(pid_t));
+    fds = (int*)malloc(jobs * sizeof(int));
+    if ((NULL == pids) || (NULL == fds)) {
+        free(pids);
+        free(fds);
+        ttRunTests();
+        return;
+    }
+
+    for (w = 0; w < jobs; ++w)
+        fds[w] = -1;
+    for (w = 0; w < jobs; ++w) {
+        if (!worker_start(w, jobs, 0, pids, fds))
+            f_ctx.fail_count += 1;
+    }
+
+    /* Read results in test order, each worker writes the results for its tests in order. If a worker dies in a test then that test is
+    	failed, & a new worker is started to run the rest of its tests. If it dies between tests the new worker starts at the next one,
+    	unless the last worker also died there, as it would again. */
+    alive = 0;
+    for (w = 0; w < jobs; ++w) {
+        if (fds[w] >= 0)
+            alive += 1;
+    }
+    retry = -1;
+    for (index = 0; alive > 0; ++index) {
+        worker_record_t rec, started;
+        int got, status = 0;
+        w = index % jobs;
+        if (fds[w] < 0)
+            continue;
+        started.kind = WORKER_DONE;		// Not started.
+        got = read_all(fds[w], &rec, sizeof(rec));
+        if (got && (WORKER_STARTED == rec.kind) && (index == rec.index)) {
+            started = rec;
+            got = read_all(fds[w], &rec, sizeof(rec));
+        }
+        if (got && (WORKER_RESULT == rec.kind) && (index == rec.index) && copy_output(fds[w], rec.len)) {
+            count_result(rec.result);
+            record_result(rec.filename, rec.lineno, rec.desc, rec.table, rec.case_index, rec.result, &rec.stats);
+            continue;
+        }
+
+        // End of results from this worker.
+        close(fds[w]);
+        fds[w] = -1;
+        alive -= 1;
+        if ((waitpid(pids[w], &status, 0) == pids[w]) && got && (WORKER_DONE == rec.kind))
+            continue;
+        if (WORKER_STARTED == started.kind) {	// Died in the test, record it as failed.
+            memset(&rec.stats, 0, sizeof(rec.stats));
+            t_ctx.tf_filename = started.filename;
+            t_ctx.tf_lineno = started.lineno;
+            t_ctx.test_desc = started.desc;
+            t_ctx.table = started.table;
+            t_ctx.case_index = started.case_index;
+            report_start(started.filename, started.lineno, started.table, started.case_index);
+            fail_exit_status(status);
+            count_result(TINY_TEST_FAIL);
+            record_result(started.filename, started.lineno, started.desc, started.table, started.case_index, TINY_TEST_FAIL, &rec.stats);
+            tt_printf(TT_PSTR("Worker %d died in test %d, starting a new worker for the rest of its tests." TT_NEWLINE), w, index + 1);
+            resume = index + jobs;
+        }
+        else {
+            if (WIFSIGNALED(status) && (NULL != signal_name(WTERMSIG(status))))
+                tt_printf(TT_PSTR("Worker %d crashed with signal %s before test %d." TT_NEWLINE), w, signal_name(WTERMSIG(status)), index + 1);
+            else if (WIFEXITED(status))
+                tt_printf(TT_PSTR("Worker %d exited with status %d before test %d." TT_NEWLINE), w, WEXITSTATUS(status), index + 1);
+            else
+                tt_printf(TT_PSTR("Worker %d exited abnormally before test %d." TT_NEWLINE), w, index + 1);
+            f_ctx.fail_count += 1;
+            if (retry == index) {
+                tt_printf(TT_PSTR("Worker %d not restarted, some tests may not have run." TT_NEWLINE), w);
+                continue;
+            }
+            retry = resume = index;
+            index -= 1;					// Read this test again from the new worker.
+        }
+        if (worker_start(w, jobs, resume, pids, fds))
+            alive += 1;
+        else
+            tt_printf(TT_PSTR("Worker %d not restarted, some tests may not have run." TT_NEWLINE), w);
+    }
+    free(pids);
+    free(fds);
+}
+#endif
+
+#ifdef TT_WANT_THREADS
+/* Thread pool. ttRunTests() is first called with f_ctx.collecting set, so that ttRunTest() just adds the selected tests to a list with
+	the fixtures registered at that point. Then the pool threads take tests from the list in order & run them with their output captured,
+	while the main thread waits for each test in turn, prints its output & counts & records the result, so the output is the same as a
+	serial run. A test marked serial runs on the main thread once all earlier tests are done, & no later test starts until it is done, so
+	it also gets the watchdog & `-x' isolation, which are not used on pool threads. */
+typedef struct {
+    void (*test_func)(void);
+    tt_pgm_str_t filename;
+    int lineno;
+    tt_pgm_str_t desc;
+    const tt_test_table_t* table;
+    unsigned case_index;
+    tt_fixture_func_t setup, teardown, dump;
+#ifdef tt_watchdog_start
+    unsigned long timeout;              // Only used if the test is serial.
+#endif
+    int serial;
+    int suite;                          // Index of the first test in its suite, or -1.
+    int suite_first, suite_last;        // Set for the first & last tests in a suite.
+    tt_fixture_func_t setup_once, teardown_once; // Suite fixtures, only set for the first test.
+    int suite_result;                   // Result of setup_once, only set for the first test.
+    int done;                           // Set by the pool thread when result, stats & output are valid.
+    int result;
+    test_stats_t stats;
+    capture_t output;
+} pool_job_t;
+
+static struct {
+    pool_job_t* jobs;
+    int count, size;
+    int next;                           // Index of the next test for a pool thread.
+    int limit;                          // Pool threads do not start tests at or after this index, the next serial test.
+    pthread_mutex_t lock;
+    pthread_cond_t cond;                // Signalled when a test is done or the limit moves.
+} f_pool;
+
+static void pool_add(void (*test_func)(void), tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc, int serial, 
+  const tt_test_table_t* table, unsigned case_index) {
+    pool_job_t* job;
+    if (f_pool.count == f_pool.size) {
+        int size = (f_pool.size > 0) ? (f_pool.size * 2) : 64;
+        pool_job_t* jobs = (pool_job_t*)realloc(f_pool.jobs, (size_t)size * sizeof(pool_job_t));
+        if (NULL == jobs) {
+            tt_printf(TT_PSTR("Out of memory adding test `%s' to the thread pool." TT_NEWLINE), desc);
+            f_ctx.fail_count += 1;
+            return;
+        }
+        f_pool.jobs = jobs;
+        f_pool.size = size;
+    }
+    job = &f_pool.jobs[f_pool.count++];
+    memset(job, 0, sizeof(*job));
+    job->test_func = test_func;
+    job->filename = filename;
+    job->lineno = lineno;
+    job->desc = desc;
+    job->table = table;
+    job->case_index = case_index;
+    job->setup = f_ctx.setup;
+    job->teardown = f_ctx.teardown;
+    job->dump = f_ctx.dump;
+#ifdef tt_watchdog_start
+    job->timeout = t_ctx.test_timeout;
+#endif
+    job->serial = serial;
+    job->suite = -1;
+    if (SUITE_PENDING == f_ctx.suite_state) {		// First selected test in the suite.
+        job->suite_first = 1;
+        job->setup_once = f_ctx.setup_once;
+        job->teardown_once = f_ctx.teardown_once;
+        f_ctx.suite_first = f_pool.count - 1;
+        f_ctx.suite_state = SUITE_STARTED;
+    }
+    if (SUITE_STARTED == f_ctx.suite_state)
+        job->suite = f_ctx.suite_first;
+}
+
+static void pool_end_suite(void) {
+    if ((SUITE_STARTED == f_ctx.suite_state) && (f_pool.count > 0))
+        f_pool.jobs[f_pool.count - 1].suite_last = 1;
+}
+
+// Grow the capture buffer, the test's allocation tracking must not see this.
+static int capture_grow(capture_t* cap) {
+    size_t size = (cap->size > 0) ? (cap->size * 2) : 256;
+    char* buf;
+#ifdef TT_HAVE_ALLOC
+    int active = t_ctx.alloc_active;
+    t_ctx.alloc_active = 0;
+#endif
+    buf = (char*)realloc(cap->buf, size);
+#ifdef TT_HAVE_ALLOC
+    t_ctx.alloc_active = active;
+#endif
+    if (NULL == buf)
+        return 0;
+    cap->buf = buf;
+    cap->size = size;
+    return 1;
+}
+
+// Run a test from the list on this thread.
+static void pool_run_job(pool_job_t* job) {
+    t_ctx.table = job->table;
+    t_ctx.case_index = job->case_index;
+    t_ctx.setup = job->setup;
+    t_ctx.teardown = job->teardown;
+    t_ctx.dump = job->dump;
+    t_ctx.suite_result = (job->suite >= 0) ? f_pool.jobs[job->suite].suite_result : TINY_TEST_SUCCESS;
+#ifdef tt_watchdog_start
+    t_ctx.test_timeout = 0;
+#endif
+    job->result = run_test_and_report(job->test_func, job->filename, job->lineno, job->desc);
+    job->stats = t_ctx.stats;
+}
+
+/* Index of the first test at or after index that pool threads must not start until the main thread gets to it, or the number of 
+	tests. That is a serial test, or the first test of a suite as the main thread runs setup_once. */
+static int pool_next_barrier(int index) {
+    while ((index < f_pool.count) && !f_pool.jobs[index].serial && !f_pool.jobs[index].suite_first)
+        ++index;
+    return index;
+}
+
+static void* pool_thread(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&f_pool.lock);
+    for (;;) {
+        pool_job_t* job;
+        while ((f_pool.next >= f_pool.limit) && (f_pool.next < f_pool.count))
+            pthread_cond_wait(&f_pool.cond, &f_pool.lock);
+        if (f_pool.next >= f_pool.count)
+            break;
+        job = &f_pool.jobs[f_pool.next++];
+        pthread_mutex_unlock(&f_pool.lock);
+
+        f_capture = &job->output;
+        pool_run_job(job);
+        f_capture = NULL;
+
+        pthread_mutex_lock(&f_pool.lock);
+        job->done = 1;
+        pthread_cond_broadcast(&f_pool.cond);
+    }
+    pthread_mutex_unlock(&f_pool.lock);
+#ifdef TT_WANT_PERF
+    perf_close();
+#endif
+    return NULL;
+}
+
+void ttRunTestsThreaded(int threads) {
+    pthread_t* tids;
+    sigset_t all, old;
+    int started, i;
+
+    if (threads <= 1) {
+        ttRunTests();
+        return;
+    }
+    memset(&f_pool, 0, sizeof(f_pool));
+    f_ctx.collecting = 1;
+    ttRunTests();
+    ttEndSuite();						// In case the last one was not ended.
+    f_ctx.collecting = 0;
+
+    tids = (pthread_t*)malloc((size_t)threads * sizeof(pthread_t));
+    if (NULL == tids) {
+        tt_printf(TT_PSTR("Failed to start thread pool." TT_NEWLINE));
+        f_ctx.fail_count += 1;
+        free(f_pool.jobs);
+        return;
+    }
+    pthread_mutex_init(&f_pool.lock, NULL);
+    pthread_cond_init(&f_pool.cond, NULL);
+    f_pool.limit = pool_next_barrier(0);
+
+    // Pool threads block all signals, so that signals like SIGALRM for the watchdog go to the main thread.
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (started = 0; started < threads; ++started) {
+        if (0 != pthread_create(&tids[started], NULL, pool_thread, NULL))
+            break;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (0 == started) {					// Run everything on this thread then.
+        f_pool.limit = 0;
+        for (i = 0; i < f_pool.count; ++i)
+            f_pool.jobs[i].serial = 1;
+    }
+
+    // Wait for each test in order, or run it here if it is serial. Suite fixtures are called here.
+    for (i = 0; i < f_pool.count; ++i) {
+        pool_job_t* job = &f_pool.jobs[i];
+        report_start(job->filename, job->lineno, job->table, job->case_index);	// Before setup_once & the output of the test.
+        if (job->suite_first)			// Pool threads cannot pass it until setup_once is done.
+            job->suite_result = run_suite_fixture(job->setup_once, job->filename, job->lineno, job->desc);
+        if (job->serial) {				// All earlier tests are done, & pool threads cannot pass it.
+            t_ctx.table = job->table;
+            t_ctx.case_index = job->case_index;
+            t_ctx.setup = job->setup;
+            t_ctx.teardown = job->teardown;
+            t_ctx.dump = job->dump;
+            t_ctx.suite_result = (job->suite >= 0) ? f_pool.jobs[job->suite].suite_result : TINY_TEST_SUCCESS;
+#ifdef tt_watchdog_start
+            t_ctx.test_timeout = job->timeout;
+#endif
+            job->result = run_test_and_report(job->test_func, job->filename, job->lineno, job->desc);
+            job->stats = t_ctx.stats;
+            pthread_mutex_lock(&f_pool.lock);
+            f_pool.next = i + 1;
+            f_pool.limit = pool_next_barrier(i + 1);
+            pthread_cond_broadcast(&f_pool.cond);
+            pthread_mutex_unlock(&f_pool.lock);
+        }
+        else {
+            size_t n;
+            pthread_mutex_lock(&f_pool.lock);
+            if (job->suite_first) {			// Let the pool threads have it.
+                f_pool.limit = pool_next_barrier(i + 1);
+                pthread_cond_broadcast(&f_pool.cond);
+            }
+            while (!job->done)
+                pthread_cond_wait(&f_pool.cond, &f_pool.lock);
+            pthread_mutex_unlock(&f_pool.lock);
+            for (n = 0; n < job->output.len; ++n)
+                tt_putchar(job->output.buf[n]);
+            free(job->output.buf);
+        }
+        count_result(job->result);
+        record_result(job->filename, job->lineno, job->desc, job->table, job->case_index, job->result, &job->stats);
+        if (job->suite_last && (TINY_TEST_SUCCESS == f_pool.jobs[job->suite].suite_result) && 
+          (TINY_TEST_SUCCESS != run_suite_fixture(f_pool.jobs[job->suite].teardown_once, job->filename, job->lineno, job->desc)))
+            f_ctx.fail_count += 1;
+    }
+
+    for (i = 0; i < started; ++i)
+        pthread_join(tids[i], NULL);
+    pthread_cond_destroy(&f_pool.cond);
+    pthread_mutex_destroy(&f_pool.lock);
+    free(tids);
+    free(f_pool.jobs);
+}
+
+/* Concurrency stress. Each round starts the threads, which wait until all have started & are then released together. Each thread has
+	its own test context with the caller's description, so an assertion jumps out on its own stack, sets the stop flag for the other
+	threads & records the iteration. Output from the threads is captured, & the output of the first thread to fail is printed by the
+	caller. Rounds are run with 1, 2, 4... up to nthreads threads to show the scaling, stopping at the first failure. */
+typedef struct {
+    tt_concurrent_func_t func;
+    unsigned long iterations;
+    tt_pgm_str_t filename;
+    int lineno;
+    tt_pgm_str_t desc;
+    const tt_test_table_t* table;
+    unsigned case_index;
+    volatile int stop;                  // Set when a thread fails, the others finish their current iteration & return.
+    int ready, go;                      // Start barrier.
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} concurrent_run_t;
+
+typedef struct {
+    concurrent_run_t* run;
+    pthread_t tid;
+    int thread;
+    unsigned long iteration;            // Count of iterations done, or the one that failed.
+    int result;
+    capture_t output;
+} concurrent_thread_t;
+
+static void* concurrent_thread(void* arg) {
+    concurrent_thread_t* th = (concurrent_thread_t*)arg;
+    concurrent_run_t* run = th->run;
+
+    t_ctx.tf_filename = run->filename;
+    t_ctx.tf_lineno = run->lineno;
+    t_ctx.test_desc = run->desc;
+    t_ctx.table = run->table;
+    t_ctx.case_index = run->case_index;
+    f_capture = &th->output;
+
+    pthread_mutex_lock(&run->lock);
+    run->ready += 1;
+    pthread_cond_broadcast(&run->cond);
+    while (!run->go)
+        pthread_cond_wait(&run->cond, &run->lock);
+    pthread_mutex_unlock(&run->lock);
+
+    th->result = setjmp(t_ctx.here);
+    if (TINY_TEST_SUCCESS == th->result) {
+        for (th->iteration = 0; (th->iteration < run->iterations) && !run->stop; ++th->iteration)
+            run->func(th->thread, th->iteration);
     }
+    else
+        run->stop = 1;
+    f_capture = NULL;
+    return NULL;
 }
 
-static void report(tt_pgm_str_t msg, char concise) {
-    switch (f_ctx.output_mode) {
-	default:	 					// No output!
-		break;
- 	case TT_OUTPUT_MODE_CONCISE:	// Just print a single char.
-        tt_putchar(concise);
-		break;
-	case TT_OUTPUT_MODE_DEFAULT:	 // Default no output for success, ignored, only failures, which are handled by another output routine.
-		break;
-	case TT_OUTPUT_MODE_VERBOSE:
-        tt_printf(TT_PSTR("[%s]: %s" TT_NEWLINE), f_ctx.test_desc, msg);
-		break;
-   }
-}
+/* Run one round on nthreads threads & return one of TINY_TEST_xxx. On a failure the output of the first thread to fail is printed, which
+	is the one that stopped at the lowest iteration, as the others stop when they see the flag. */
+static int concurrent_round(concurrent_run_t* run, concurrent_thread_t* threads, int nthreads, unsigned long* elapsed) {
+    concurrent_thread_t* failed = NULL;
+    sigset_t all, old;
+    int started, i;
+#ifdef tt_clock
+    tt_clock_t start;
+#endif
 
-void ttRunTest(void (*test_func)(void), tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc) {
-    if ((NULL == f_ctx.groupstr) || (NULL != strstr(desc, f_ctx.groupstr))) { // Decide whether to run this test...
-        int exc;
+    run->stop = 0;
+    run->ready = run->go = 0;
+    memset(threads, 0, (size_t)nthreads * sizeof(concurrent_thread_t));
+    sigfillset(&all);						// Threads block all signals, they go to the test's thread.
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (started = 0; started < nthreads; ++started) {
+        threads[started].run = run;
+        threads[started].thread = started;
+        if (0 != pthread_create(&threads[started].tid, NULL, concurrent_thread, &threads[started]))
+            break;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
 
-        // Setup the test context.
-        f_ctx.tf_filename = filename;
-        f_ctx.tf_lineno = lineno;
-        f_ctx.test_desc = desc;
+    pthread_mutex_lock(&run->lock);
+    while (run->ready < started)
+        pthread_cond_wait(&run->cond, &run->lock);
+#ifdef tt_clock
+    start = tt_clock();
+#endif
+    run->stop = (started < nthreads);	// Just let them go if some did not start.
+    run->go = 1;
+    pthread_cond_broadcast(&run->cond);
+    pthread_mutex_unlock(&run->lock);
+    for (i = 0; i < started; ++i)
+        pthread_join(threads[i].tid, NULL);
+#ifdef tt_clock
+    *elapsed = (unsigned long)(tt_clock() - start);
+#else
+    *elapsed = 0UL;
+#endif
 
-        // Print leader for verbose mode.
-        if (TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode)
-            tt_printf(TT_PSTR("%s:%d: "), filename, lineno);
+    for (i = 0; i < started; ++i) {
+        if ((TINY_TEST_SUCCESS != threads[i].result) && ((NULL == failed) || (threads[i].iteration < failed->iteration)))
+            failed = &threads[i];
+    }
+    if (NULL != failed) {
+        size_t n;
+        for (n = 0; n < failed->output.len; ++n)
+            tt_putchar(failed->output.buf[n]);
+#ifndef TT_WANT_TOKENS
+        if ((TT_OUTPUT_MODE_DEFAULT == f_ctx.output_mode) || (TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode))
+            tt_printf(TT_PSTR("# On thread %d of %d at iteration %lu." TT_NEWLINE), failed->thread, nthreads, failed->iteration);
+#endif
+    }
+    for (i = 0; i < started; ++i)
+        free(threads[i].output.buf);
+    if (NULL != failed)
+        return failed->result;
+    if (started < nthreads) {
+        tt_print_fail_message(run->filename, run->lineno, TT_PSTR("Failed to start thread %d of %d"), started, nthreads);
+        return TINY_TEST_FAIL;
+    }
+    return TINY_TEST_SUCCESS;
+}
 
-        // Call the test, set flag on failure.
-        exc = setjmp(f_ctx.here);
-        if (TINY_TEST_SUCCESS == exc) { 	    // When setjmp is called normally it just returns 0.
-            if (NULL != f_ctx.setup)			// Call fixture setup func.
-                f_ctx.setup();
-            test_func();
+void ttRunConcurrent(tt_concurrent_func_t func, int nthreads, unsigned long iterations) {
+    concurrent_run_t run;
+    concurrent_thread_t* threads;
+    int result = TINY_TEST_SUCCESS;
+    int n;
+    unsigned long elapsed;
+#if defined(tt_clock) && !defined(TT_WANT_TOKENS)
+    unsigned long single = 0UL;			// Rate for one thread.
+#endif
+    sigset_t alarm, old;
+#ifdef TT_HAVE_ALLOC
+    int alloc_active = t_ctx.alloc_active;
+    t_ctx.alloc_active = 0;				// The threads & buffers are not the test's allocations.
+#endif
 
-            // If we get here then the test has passed.
-            report("OK", '.');
-            f_ctx.pass_count += 1;
-        }
-        else if (TINY_TEST_IGNORED == exc) { 	// This test has been flagged as IGNORED.
-			report("IGNORED", 'I');				// Handle output reporting.
-			f_ctx.ignore_count += 1;
-        }
-        else { // We have a failure. Call dump function if non-NULL.
-            if (NULL != f_ctx.dump)
-                f_ctx.dump();
-            f_ctx.fail_count += 1;
-        }
+    if (nthreads < 1)
+        nthreads = 1;
+    threads = (concurrent_thread_t*)malloc((size_t)nthreads * sizeof(concurrent_thread_t));
+    if (NULL == threads) {
+        tt_print_fail_message(t_ctx.tf_filename, t_ctx.tf_lineno, TT_PSTR("Out of memory starting %d threads"), nthreads);
+        result = TINY_TEST_FAIL;
+    }
+    memset(&run, 0, sizeof(run));
+    run.func = func;
+    run.iterations = iterations;
+    run.filename = t_ctx.tf_filename;
+    run.lineno = t_ctx.tf_lineno;
+    run.desc = t_ctx.test_desc;
+    run.table = t_ctx.table;
+    run.case_index = t_ctx.case_index;
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.cond, NULL);
 
-        if (NULL != f_ctx.teardown)
-            f_ctx.teardown();
+    // The watchdog must not jump out while the threads are using this frame, a timeout is delivered when they are done.
+    sigemptyset(&alarm);
+    sigaddset(&alarm, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alarm, &old);
+    for (n = 1; (NULL != threads) && (TINY_TEST_SUCCESS == result); n *= 2) {
+        if (n > nthreads)
+            n = nthreads;
+        result = concurrent_round(&run, threads, n, &elapsed);
+#if defined(tt_clock) && !defined(TT_WANT_TOKENS)
+        if ((TINY_TEST_SUCCESS == result) && (TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode)) {
+            unsigned long rate = (elapsed > 0UL) ? (unsigned long)((unsigned long long)n * iterations * 1000000ULL / elapsed) : 0UL;
+            tt_printf(TT_PSTR("# Concurrent %d thread%s, %lu ops/s"), n, (1 == n) ? "" : "s", rate);
+            if (1 == n)
+                single = rate;
+            else if (single > 0UL)
+                tt_printf(TT_PSTR(", scaling %lu.%02lux"), rate / single, (rate % single) * 100UL / single);
+            tt_printf(TT_PSTR("." TT_NEWLINE));
+        }
+#endif
+        if (n == nthreads)
+            break;
     }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    pthread_cond_destroy(&run.cond);
+    pthread_mutex_destroy(&run.lock);
+    free(threads);
+#ifdef TT_HAVE_ALLOC
+    t_ctx.alloc_active = alloc_active;
+#endif
+    if (TINY_TEST_SUCCESS != result)
+        tt_abort(result);
 }
+#endif
 
 int ttFinish(void) {
+    ttEndSuite();						// In case the last one was not ended.
+#ifdef TT_WANT_PERF
+    perf_close();
+#endif
     switch (f_ctx.output_mode) {
 	default:	 					// No output!
 		break;
@@ -239,16 +3273,93 @@ int ttFinish(void) {
 	case TT_OUTPUT_MODE_DEFAULT:
 		// Fall through...
 	case TT_OUTPUT_MODE_VERBOSE:
+#ifdef tt_clock
+        if ((TT_OUTPUT_MODE_CONCISE != f_ctx.output_mode) && (NULL != f_ctx.slowest[0].desc)) {
+            int i;
+#ifdef TT_WANT_TOKENS
+            for (i = 0; (i < TT_SLOWEST_COUNT) && (NULL != f_ctx.slowest[i].desc); ++i) {	// The decoder prints the list.
+                token_start(TT_TOKEN_SLOW);
+                token_location(f_ctx.slowest[i].filename, f_ctx.slowest[i].lineno);
+                token_put32((unsigned long)f_ctx.slowest[i].elapsed);
+            }
+#else
+            tt_printf(TT_PSTR("------------------------------------------------\n"));
+            tt_printf(TT_PSTR("Slowest tests:" TT_NEWLINE));
+            for (i = 0; (i < TT_SLOWEST_COUNT) && (NULL != f_ctx.slowest[i].desc); ++i) {
+                tt_printf(TT_PSTR("  "));
+                print_time(f_ctx.slowest[i].elapsed);
+                tt_printf(TT_PSTR(" %s:%d: %s" TT_NEWLINE), f_ctx.slowest[i].filename, f_ctx.slowest[i].lineno, f_ctx.slowest[i].desc);
+            }
+#endif
+        }
+#endif
+#ifdef TT_HAVE_ALLOC
+        if ((TT_OUTPUT_MODE_CONCISE != f_ctx.output_mode) && (f_ctx.total_allocs > 0)) {
+#ifdef TT_WANT_TOKENS
+            token_start(TT_TOKEN_ALLOCS);
+            token_location(f_ctx.alloc_peak.filename, f_ctx.alloc_peak.lineno);
+            token_put32(f_ctx.total_allocs);
+            token_put32(f_ctx.total_alloc_bytes);
+            token_put32(f_ctx.alloc_peak.peak);
+#else
+            tt_printf(TT_PSTR("------------------------------------------------\n"));
+            tt_printf(TT_PSTR("Allocations %lu, bytes %lu, highest peak %lu bytes in %s:%d: %s" TT_NEWLINE), f_ctx.total_allocs, 
+              f_ctx.total_alloc_bytes, f_ctx.alloc_peak.peak, f_ctx.alloc_peak.filename, f_ctx.alloc_peak.lineno, f_ctx.alloc_peak.desc);
+#endif
+        }
+#endif
+#ifdef tt_stack_bounds
+        if ((TT_OUTPUT_MODE_CONCISE != f_ctx.output_mode) && (NULL != f_ctx.stack_peak.desc)) {
+#ifdef TT_WANT_TOKENS
+            token_start(TT_TOKEN_STACK);
+            token_location(f_ctx.stack_peak.filename, f_ctx.stack_peak.lineno);
+            token_put32(f_ctx.stack_peak.peak);
+#else
+            tt_printf(TT_PSTR("------------------------------------------------\n"));
+            tt_printf(TT_PSTR("Deepest stack %lu bytes in %s:%d: %s" TT_NEWLINE), f_ctx.stack_peak.peak, 
+              f_ctx.stack_peak.filename, f_ctx.stack_peak.lineno, f_ctx.stack_peak.desc);
+#endif
+        }
+#endif
+#ifndef TT_WANT_TOKENS
         tt_printf(TT_PSTR("------------------------------------------------\n"));
-        tt_printf(TT_PSTR("Passed %d, failed %d, ignored %d.\n"),
+        tt_printf(TT_PSTR("Passed %d, failed %d, ignored %d"),
           f_ctx.pass_count,
           f_ctx.fail_count,
           f_ctx.ignore_count);
-        tt_printf((f_ctx.fail_count > 0) ? TT_PSTR("FAIL") : TT_PSTR("OK"));
+        if (f_ctx.timeout_count > 0)
+            tt_printf(TT_PSTR(", timed out %d"), f_ctx.timeout_count);
+        tt_printf(TT_PSTR(".\n"));
+#endif
+#ifdef tt_clock
+#ifdef TT_WANT_TOKENS
+        token_start(TT_TOKEN_TIME);
+        token_put32((unsigned long)(tt_clock() - f_ctx.start_time));
+        token_put32((unsigned long)f_ctx.total_time);
+#else
+        tt_printf(TT_PSTR("Total time "));
+        print_time(tt_clock() - f_ctx.start_time);
+        tt_printf(TT_PSTR(", in tests "));
+        print_time(f_ctx.total_time);
+        tt_printf(TT_PSTR("." TT_NEWLINE));
+#endif
+#endif
+#ifdef TT_WANT_TOKENS
+        token_start(TT_TOKEN_SUMMARY);		// The decoder prints the summary.
+        token_put16((unsigned)f_ctx.pass_count);
+        token_put16((unsigned)f_ctx.fail_count);
+        token_put16((unsigned)f_ctx.ignore_count);
+        token_put16((unsigned)f_ctx.timeout_count);
+#else
+        tt_printf(((f_ctx.fail_count + f_ctx.timeout_count) > 0) ? TT_PSTR("FAIL") : TT_PSTR("OK"));
         tt_printf(TT_PSTR(TT_NEWLINE));
+#endif
 		break;
     }
-    return f_ctx.fail_count > 0;
+#ifdef TT_WANT_FILES
+    close_files();
+#endif
+    return (f_ctx.fail_count + f_ctx.timeout_count) > 0;
 }
 
 /*  Optional main function.
@@ -263,9 +3374,42 @@ typedef struct {
 } option_def_t;
 
 static int output_mode = TT_OUTPUT_MODE_DEFAULT;
-static int pause = 0;
+static int want_pause = 0;
 static int help = 0;
 static char* tests;
+static char* shard;
+static unsigned long prop_seed = 0UL;
+#ifdef TT_WANT_FORK
+static int jobs = 1;
+static int isolate = 0;
+#endif
+#ifdef TT_WANT_THREADS
+static int threads = 1;
+#endif
+#ifdef tt_watchdog_start
+static int timeout_ms = 0;
+#endif
+#ifdef tt_stack_bounds
+static int stack_limit = 0;
+#endif
+#ifdef tt_clock
+static int time_limit_ms = 0;
+static int bench = 0;
+#endif
+#ifdef TT_WANT_FILES
+static char* results_filename;
+static char* baseline_filename;
+static int threshold = TT_BENCH_THRESHOLD;
+static int failed_first = 0;
+static int last_failed = 0;
+#endif
+#ifdef TT_HAVE_COVERAGE
+static char* coverage_dir;
+#endif
+#ifdef TT_WANT_REGISTRY
+static int list_tests = 0;
+static int test_select = -1;
+#endif
 
 static void opt_handler_bool_set(int* argidx, char* argv[], void* val) { *(int*)val = 1; }
 static void opt_handler_verbose(int* argidx, char* argv[], void* val) { *(int*)val = TT_OUTPUT_MODE_VERBOSE; }
@@ -276,16 +3420,72 @@ static void opt_handler_str(int* argidx, char* argv[], void* val) {
     *argidx += 1;
     *(const char**)val = argv[*argidx];
 }
+static void opt_handler_ulong(int* argidx, char* argv[], void* val) {
+    *argidx += 1;
+    *(unsigned long*)val = (NULL != argv[*argidx]) ? strtoul(argv[*argidx], NULL, 10) : 0UL;
+}
+#if defined(TT_WANT_FORK) || defined(TT_WANT_THREADS) || defined(tt_clock) || defined(TT_WANT_FILES) || defined(tt_watchdog_start) || defined(tt_stack_bounds) || defined(TT_WANT_REGISTRY)
+static void opt_handler_int(int* argidx, char* argv[], void* val) {
+    *argidx += 1;
+    *(int*)val = (NULL != argv[*argidx]) ? atoi(argv[*argidx]) : 0;
+}
+#endif
 option_def_t OPTIONS[] = {
     { '?', opt_handler_bool_set, &help },
     { 'v', opt_handler_verbose, &output_mode },
     { 'q', opt_handler_quiet, &output_mode },
     { 'c', opt_handler_concise, &output_mode },
-    { 'p', opt_handler_bool_set, &pause },
+    { 'p', opt_handler_bool_set, &want_pause },
     { 'g', opt_handler_str, &tests },
+    { 'S', opt_handler_ulong, &prop_seed },
+    { 'n', opt_handler_str, &shard },
+#ifdef TT_WANT_FORK
+    { 'j', opt_handler_int, &jobs },
+    { 'x', opt_handler_bool_set, &isolate },
+#endif
+#ifdef TT_WANT_THREADS
+    { 'm', opt_handler_int, &threads },
+#endif
+#ifdef tt_watchdog_start
+    { 'w', opt_handler_int, &timeout_ms },
+#endif
+#ifdef tt_stack_bounds
+    { 's', opt_handler_int, &stack_limit },
+#endif
+#ifdef tt_clock
+    { 't', opt_handler_int, &time_limit_ms },
+    { 'b', opt_handler_bool_set, &bench },
+#endif
+#ifdef TT_WANT_FILES
+    { 'o', opt_handler_str, &results_filename },
+    { 'r', opt_handler_str, &baseline_filename },
+    { 'R', opt_handler_int, &threshold },
+    { 'F', opt_handler_bool_set, &failed_first },
+    { 'L', opt_handler_bool_set, &last_failed },
+#endif
+#ifdef TT_HAVE_COVERAGE
+    { 'C', opt_handler_str, &coverage_dir },
+#endif
+#ifdef TT_WANT_REGISTRY
+    { 'l', opt_handler_bool_set, &list_tests },
+    { 'i', opt_handler_int, &test_select },
+#endif
 };
 #define NUM_OPTIONS ((int)(sizeof(OPTIONS) / sizeof(OPTIONS[0])))
 
+static void run_tests(void) {
+#ifdef TT_WANT_THREADS
+    if (threads > 1)
+        ttRunTestsThreaded(threads);
+    else
+#endif
+#ifdef TT_WANT_FORK
+        ttRunTestsParallel(jobs);
+#else
+        ttRunTests();
+#endif
+}
+
 static int handle_options(int argc, char* argv[]) {
     int argidx;
 
@@ -313,23 +3513,135 @@ int ttMain(int argc, char* argv[]) {
 	if (rc)
 		return rc;
 	if (help) {
-        tt_printf(TT_PSTR(
-		  "Tinytest test harness %s [options]. Return value is number of failures.\n"
-		  " Default is to print full information for failures only, with totals.\n"
-		  "  -?  print help\n"
-		  "  -q  quiet, no output at all\n"
-		  "  -c  concise output `FI.' for fail/ignored/pass, with totals\n"
-		  "  -v  verbose output, information for all tests\n"
-		  "  -p  pause after running tests, print message and wait for return\n"
-		  "  -g <str> only run tests containing str (case sensitive)\n"
-		), argv[0]);
+        tt_printf(TT_PSTR("Tinytest test harness %s [options]. Return value is number of failures.\n"), argv[0]);
+        tt_printf(TT_PSTR(" Default is to print full information for failures only, with totals.\n"));
+        tt_printf(TT_PSTR("  -?  print help\n"));
+        tt_printf(TT_PSTR("  -q  quiet, no output at all\n"));
+        tt_printf(TT_PSTR("  -c  concise output `FI.' for fail/ignored/pass, with totals\n"));
+        tt_printf(TT_PSTR("  -v  verbose output, information for all tests\n"));
+        tt_printf(TT_PSTR("  -p  pause after running tests, print message and wait for return\n"));
+        tt_printf(TT_PSTR("  -g <str> only run tests containing str (case sensitive)\n"));
+        tt_printf(TT_PSTR("  -S <seed> seed for property tests, to reproduce a failure\n"));
+        tt_printf(TT_PSTR("  -n <i/n> only run shard i of n shards of the tests, balanced by the test times in the -r file if given\n"));
+#ifdef TT_WANT_FORK
+        tt_printf(TT_PSTR("  -j <n> run tests in n parallel worker processes\n"));
+        tt_printf(TT_PSTR("  -x  run each test in a forked child, so a crash only fails that test\n"));
+#endif
+#ifdef TT_WANT_THREADS
+        tt_printf(TT_PSTR("  -m <n> run tests on n threads in this process, tests marked serial run alone, -j is ignored\n"));
+#endif
+#ifdef tt_watchdog_start
+        tt_printf(TT_PSTR("  -w <ms> stop tests that run for longer than ms milliseconds and count them as timed out\n"));
+#endif
+#ifdef tt_stack_bounds
+        tt_printf(TT_PSTR("  -s <bytes> fail tests that use more than this much stack\n"));
+#endif
+#ifdef tt_clock
+        tt_printf(TT_PSTR("  -t <ms> fail tests that take longer than ms milliseconds\n"));
+        tt_printf(TT_PSTR("  -b  run benchmarks instead of tests, -j is ignored\n"));
+#endif
+#ifdef TT_WANT_FILES
+        tt_printf(TT_PSTR("  -o <file> write results of tests & benchmarks to file\n"));
+        tt_printf(TT_PSTR("  -r <file> fail benchmarks that are slower than the results in file\n"));
+        tt_printf(TT_PSTR("  -R <percent> slowdown from -r results that fails a benchmark\n"));
+        tt_printf(TT_PSTR("  -F  run tests that failed in the last run first\n"));
+        tt_printf(TT_PSTR("  -L  only run tests that failed in the last run\n"));
+        tt_printf(TT_PSTR("      -F & -L read & rewrite the failed tests in %s\n"), TT_LAST_FAILED_FILE);
+#endif
+#ifdef TT_HAVE_COVERAGE
+        tt_printf(TT_PSTR("  -C <dir> write the coverage of each test to dir, which must not exist, -m is ignored\n"));
+#endif
+#ifdef TT_WANT_REGISTRY
+        tt_printf(TT_PSTR("  -l  list registered tests with their index\n"));
+        tt_printf(TT_PSTR("  -i <index> only run the registered test with this index\n"));
+#endif
 		return 1;
 	}
+#ifdef TT_WANT_REGISTRY
+    if (list_tests) {
+        ttListRegisteredTests();
+        return 0;
+    }
+#endif
 
     ttStart(output_mode, tests);
-    ttRunTests();
+    ttSetPropertySeed(prop_seed);
+#ifdef tt_watchdog_start
+    ttSetTimeout((unsigned long)timeout_ms);
+#endif
+#ifdef tt_stack_bounds
+    ttSetStackLimit((unsigned long)stack_limit);
+#endif
+#ifdef tt_clock
+    ttSetTimeLimit((tt_clock_t)time_limit_ms * 1000);
+    ttSetBenchMode(bench);
+#ifdef TT_WANT_FORK
+    if (bench)					// Benchmarks are never run in parallel as they would disturb each other.
+        jobs = 1;
+#endif
+#ifdef TT_WANT_THREADS
+    if (bench)
+        threads = 1;
+#endif
+#endif
+#ifdef TT_WANT_FILES
+    if (threshold < 0) {
+        tt_printf(TT_PSTR("Illegal threshold: `%d'.\n"), threshold);
+        return 2;
+    }
+    if ((NULL != baseline_filename) && (0 != ttReadBaseline(baseline_filename, threshold))) {
+        tt_printf(TT_PSTR("Cannot read baseline results file `%s'.\n"), baseline_filename);
+        return 2;
+    }
+    if ((NULL != results_filename) && (0 != ttWriteResults(results_filename))) {
+        tt_printf(TT_PSTR("Cannot write results file `%s'.\n"), results_filename);
+        return 2;
+    }
+    // Only touch the failed tests file if asked, so a plain run does not write to the current directory.
+    if ((failed_first || last_failed) && (0 != ttReadLastFailed(TT_LAST_FAILED_FILE)))
+        tt_printf(TT_PSTR("Cannot read failed tests file `%s', all tests are run.\n"), TT_LAST_FAILED_FILE);
+#endif
+#ifdef TT_HAVE_COVERAGE
+    if (NULL != coverage_dir) {
+        if (0 != ttCaptureCoverage(coverage_dir)) {
+            tt_printf(TT_PSTR("Cannot create coverage directory `%s', it must not exist.\n"), coverage_dir);
+            return 2;
+        }
+#ifdef TT_WANT_THREADS
+        threads = 1;					// The threads would share the counters.
+#endif
+    }
+#endif
+#ifdef TT_WANT_FORK
+    ttSetIsolation(isolate);
+#endif
+#ifdef TT_WANT_REGISTRY
+    if (0 != ttSelectRegisteredTest(test_select)) {
+        tt_printf(TT_PSTR("Illegal test index: `%d', there are %u registered tests.\n"), test_select, ttRegisteredTestCount());
+        return 2;
+    }
+#endif
+    if (NULL != shard) {
+        char* end;
+        int i = (int)strtol(shard, &end, 10);
+        int n = ('/' == *end) ? (int)strtol(end + 1, &end, 10) : 0;
+        if (('\0' != *end) || (i < 1) || (i > n)) {
+            tt_printf(TT_PSTR("Illegal shard: `%s'.\n"), shard);
+            return 2;
+        }
+        ttSetShard(i, n);
+    }
+#ifdef TT_WANT_FILES
+    if (failed_first || last_failed) {
+        ttSelectLastFailed(TT_LAST_FAILED_ONLY);
+        run_tests();
+        ttSelectLastFailed(TT_LAST_FAILED_OTHERS);
+    }
+    if (!last_failed)
+#endif
+        run_tests();
     rc = ttFinish();
-    if (pause) {
+    if (want_pause) {
 #ifdef tt_wait_enter
         tt_printf(TT_PSTR("Press the <enter> key to continue..."));
         tt_wait_enter();
@@ -338,31 +3650,642 @@ int ttMain(int argc, char* argv[]) {
 	return rc;
 }
 
-static void start_random(int seed) {
-    srand(seed);
+/* Memory fill pattern. A xorshift PRNG makes a word at a time, it has its own state so it does not disturb rand(). Every byte has 
+	bit 0 set & bit 7 clear, so it is never 0 or 0xff, which are common values in munged memory. The buffer is split into segments 
+	that end on word boundaries, each gets a new word, and the byte at address a is byte (a % word size) of the word. So the pattern 
+	depends on the address as well as the seed, and the middle of the buffer is written & checked a word at a time. */
+typedef unsigned long fill_word_t;
+#define FILL_WORD_SIZE sizeof(fill_word_t)
+#define FILL_OFFSET(p_) ((size_t)(p_) & (FILL_WORD_SIZE - 1))
+#define FILL_BYTES(b_) ((fill_word_t)-1 / 0xffU * (b_))
+
+// Number of corrupted ranges printed by ttVerifyMemory(), and the bytes of each shown in the hex dump.
+#ifndef TT_VERIFY_MAX_RANGES
+#define TT_VERIFY_MAX_RANGES 8
+#endif
+#ifndef TT_VERIFY_DUMP_BYTES
+#define TT_VERIFY_DUMP_BYTES 16
+#endif
+
+static fill_word_t fill_start(int seed) {
+    fill_word_t x = (fill_word_t)(unsigned)seed * 2654435761UL + 0x9e3779b9UL;		// Spread small seeds, never zero.
+    return (0UL == x) ? 1UL : x;
 }
-static char get_random() {
-	char r;
-	do { r = (char)rand(); } while ((0 == r) || (0xff == r)); // Exclude 0 & ff, both common values in munged memory.
-	return r;
+static fill_word_t fill_next(fill_word_t* state) {
+    fill_word_t x = *state;
+#if ULONG_MAX > 0xffffffffUL
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+#else
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+#endif
+    *state = x;
+    return (x & FILL_BYTES(0x7fU)) | FILL_BYTES(0x01U);
 }
+
 void ttFillMemory(void* buf, size_t len, int seed) {
-	char* cbuf = (char*)buf;
-    start_random(seed);
-    while (len--)
-        *cbuf++ = get_random();
+    char* p = (char*)buf;
+    char* end = p + len;
+    fill_word_t state = fill_start(seed);
+    fill_word_t w;
+
+    if ((len > 0) && (0 != FILL_OFFSET(p))) {		// Head up to the first word boundary.
+        size_t n = FILL_WORD_SIZE - FILL_OFFSET(p);
+        if (n > len)
+            n = len;
+        w = fill_next(&state);
+        memcpy(p, (const char*)&w + FILL_OFFSET(p), n);
+        p += n;
+    }
+    while ((size_t)(end - p) >= FILL_WORD_SIZE) {
+        w = fill_next(&state);
+        memcpy(p, &w, FILL_WORD_SIZE);			// Compiles to a single aligned store.
+        p += FILL_WORD_SIZE;
+    }
+    if (p < end) {
+        w = fill_next(&state);
+        memcpy(p, &w, (size_t)(end - p));
+    }
+}
+
+#ifndef TT_WANT_TOKENS
+// Print a range of corrupted bytes with a hex dump of the expected & actual values.
+static void print_corrupt_range(const unsigned char* start, const unsigned char* expected, size_t len) {
+    size_t i, n = (len < TT_VERIFY_DUMP_BYTES) ? len : TT_VERIFY_DUMP_BYTES;
+    tt_printf(TT_PSTR("  0x%lx..0x%lx, %lu bytes" TT_NEWLINE "    expected"), (unsigned long)(size_t)start, 
+      (unsigned long)(size_t)(start + len - 1), (unsigned long)len);
+    for (i = 0; i < n; ++i)
+        tt_printf(TT_PSTR(" %02x"), expected[i]);
+    if (n < len)
+        tt_printf(TT_PSTR(" ..."));
+    tt_printf(TT_PSTR(TT_NEWLINE "    actual  "));
+    for (i = 0; i < n; ++i)
+        tt_printf(TT_PSTR(" %02x"), start[i]);
+    if (n < len)
+        tt_printf(TT_PSTR(" ..."));
+    tt_printf(TT_PSTR(TT_NEWLINE));
+}
+#endif
+
+/* Find corrupted bytes one at a time, calling print_corrupt_range() for each range if do_print is set, which is ignored with tokens. 
+	Returns the number of ranges, the number of bytes is returned in nbad. */
+static unsigned long find_corrupt_ranges(const void* buf, size_t len, int seed, int do_print, unsigned long* nbad) {
+    const unsigned char* p = (const unsigned char*)buf;
+    const unsigned char* range_start = NULL;
+#ifndef TT_WANT_TOKENS
+    unsigned char expected[TT_VERIFY_DUMP_BYTES];
+#endif
+    fill_word_t state = fill_start(seed);
+    fill_word_t w = 0UL;
+    unsigned long nranges = 0UL;
+    size_t i;
+
+    *nbad = 0UL;
+    for (i = 0; i <= len; ++i, ++p) {
+        int bad = 0;
+        unsigned char e = 0;
+        if (i < len) {
+            if ((0 == i) || (0 == FILL_OFFSET(p)))		// New segment.
+                w = fill_next(&state);
+            e = ((const unsigned char*)&w)[FILL_OFFSET(p)];
+            bad = (*p != e);
+        }
+        if (bad) {
+            if (NULL == range_start)
+                range_start = p;
+#ifndef TT_WANT_TOKENS
+            if ((size_t)(p - range_start) < TT_VERIFY_DUMP_BYTES)
+                expected[p - range_start] = e;
+#endif
+            *nbad += 1;
+        }
+        else if (NULL != range_start) {			// End of a range.
+#ifndef TT_WANT_TOKENS
+            if (do_print && (nranges < TT_VERIFY_MAX_RANGES))
+                print_corrupt_range(range_start, expected, (size_t)(p - range_start));
+#endif
+            nranges += 1;
+            range_start = NULL;
+        }
+    }
+    return nranges;
+}
+
+// Check a buffer a word at a time in the same way as ttFillMemory(), returns non-zero if it is unchanged.
+static int fill_matches(const void* buf, size_t len, int seed) {
+    const char* p = (const char*)buf;
+    const char* end = p + len;
+    fill_word_t state = fill_start(seed);
+    fill_word_t w, actual;
+
+    if ((len > 0) && (0 != FILL_OFFSET(p))) {
+        size_t n = FILL_WORD_SIZE - FILL_OFFSET(p);
+        if (n > len)
+            n = len;
+        w = fill_next(&state);
+        if (0 != memcmp(p, (const char*)&w + FILL_OFFSET(p), n))
+            return 0;
+        p += n;
+    }
+    while ((size_t)(end - p) >= FILL_WORD_SIZE) {
+        w = fill_next(&state);
+        memcpy(&actual, p, FILL_WORD_SIZE);
+        if (actual != w)
+            return 0;
+        p += FILL_WORD_SIZE;
+    }
+    if (p < end) {
+        w = fill_next(&state);
+        if (0 != memcmp(p, &w, (size_t)(end - p)))
+            return 0;
+    }
+    return 1;
 }
+
 void ttVerifyMemory(const void* buf, size_t len, int seed, tt_pgm_str_t filename, int lineno) {
-	const char* cbuf = (char*)buf;
-    start_random(seed);
-    while (len--) {
-        char expected = get_random();
-        if (*cbuf != expected) {
-            tt_print_fail_message(filename, lineno, TT_PSTR("Verify memory fail address: 0x%lx"), cbuf);
-            tt_abort(TINY_TEST_FAIL);
+    unsigned long nranges, nbad;
+
+    if (fill_matches(buf, len, seed))
+        return;
+
+    // Slow path, count & then print the corrupted ranges.
+    nranges = find_corrupt_ranges(buf, len, seed, 0, &nbad);
+    tt_print_fail_message(filename, lineno, TT_PSTR("Memory at 0x%lx corrupted, %lu bytes in %lu ranges"), (unsigned long)(size_t)buf, nbad, nranges);
+#ifndef TT_WANT_TOKENS					// The ranges are only listed in text output.
+    if ((TT_OUTPUT_MODE_DEFAULT == f_ctx.output_mode) || (TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode)) {
+        find_corrupt_ranges(buf, len, seed, 1, &nbad);
+        if (nranges > TT_VERIFY_MAX_RANGES)
+            tt_printf(TT_PSTR("  and %lu more ranges" TT_NEWLINE), nranges - TT_VERIFY_MAX_RANGES);
+    }
+#endif
+    tt_abort(TINY_TEST_FAIL);
+}
+
+/* Guard zones are filled with the same pattern, seeded differently either side & from the buffer, so that a write that runs off 
+	either end is caught by ttVerifyGuards(). */
+void ttFillGuards(void* buf, size_t len, size_t guard_len) {
+    ttFillMemory((char*)buf - guard_len, guard_len, TT_GUARD_SEED);
+    ttFillMemory((char*)buf + len, guard_len, TT_GUARD_SEED + 1);
+}
+void ttVerifyGuards(const void* buf, size_t len, size_t guard_len, tt_pgm_str_t filename, int lineno) {
+    ttVerifyMemory((const char*)buf - guard_len, guard_len, TT_GUARD_SEED, filename, lineno);
+    ttVerifyMemory((const char*)buf + len, guard_len, TT_GUARD_SEED + 1, filename, lineno);
+}
+
+/* Buffer comparison. The buffers are compared with memcmp(), which is vectorised by most libraries, & only if they differ are they
+	compared again a chunk at a time, skipping equal chunks with memcmp(), to count the mismatched bytes. */
+#ifndef TT_MEM_WINDOW
+#define TT_MEM_WINDOW 16				// Bytes shown around the first mismatch.
+#endif
+#ifndef TT_FLOAT_WINDOW
+#define TT_FLOAT_WINDOW 8				// Values shown around the first mismatch.
+#endif
+#define MEM_CHUNK 256
+
+#ifndef TT_WANT_TOKENS
+// Print a row of the hex window.
+static void print_mem_row(tt_pgm_str_t label, const unsigned char* p, size_t n) {
+    size_t i;
+    tt_printf(label);
+    for (i = 0; i < n; ++i)
+        tt_printf(TT_PSTR(" %02x"), p[i]);
+    tt_printf(TT_PSTR(TT_NEWLINE));
+}
+#endif
+
+void ttAssertMem(const void* actual, const void* expected, size_t len, tt_pgm_str_t name, tt_pgm_str_t filename, int lineno) {
+    const unsigned char* a = (const unsigned char*)actual;
+    const unsigned char* e = (const unsigned char*)expected;
+    size_t i, first = len;
+    unsigned long nbad = 0UL;
+
+    if (0 == memcmp(a, e, len))
+        return;
+
+    for (i = 0; i < len; i += MEM_CHUNK) {
+        size_t j, n = ((len - i) < MEM_CHUNK) ? (len - i) : MEM_CHUNK;
+        if (0 == memcmp(a + i, e + i, n))
+            continue;
+        for (j = i; j < i + n; ++j) {
+            if (a[j] != e[j]) {
+                if (first == len)
+                    first = j;
+                nbad += 1;
+            }
+        }
+    }
+    tt_print_fail_message(filename, lineno, TT_PSTR("Expected `" TT_FMT_PSTR "' to match, %lu of %lu bytes differ, first at offset %lu"), 
+      name, nbad, (unsigned long)len, (unsigned long)first);
+#ifndef TT_WANT_TOKENS					// The window is only in text output.
+    if ((TT_OUTPUT_MODE_DEFAULT == f_ctx.output_mode) || (TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode)) {
+        size_t start = (first > TT_MEM_WINDOW / 2) ? (first - TT_MEM_WINDOW / 2) : 0;
+        size_t n = ((len - start) < TT_MEM_WINDOW) ? (len - start) : TT_MEM_WINDOW;
+        tt_printf(TT_PSTR("  offset %lu" TT_NEWLINE), (unsigned long)start);
+        print_mem_row(TT_PSTR("    expected"), e + start, n);
+        print_mem_row(TT_PSTR("    actual  "), a + start, n);
+        while (a[start + n - 1] == e[start + n - 1])		// Mark up to the last difference in the window.
+            --n;
+        tt_printf(TT_PSTR("            "));
+        for (i = start; i < start + n; ++i)
+            tt_printf((a[i] != e[i]) ? TT_PSTR(" ^^") : TT_PSTR("   "));
+        tt_printf(TT_PSTR(TT_NEWLINE));
+    }
+#endif
+    tt_abort(TINY_TEST_FAIL);
+}
+
+// Format a value as `-d.dddddde+dd' as the internal printf has no floating point. The buffer must hold at least 16 chars.
+static void format_double(char* buf, double v) {
+    unsigned long m;
+    int exp = 0, i;
+
+    if (v != v) {
+        strcpy(buf, "nan");
+        return;
+    }
+    if (v < 0.0) {
+        *buf++ = '-';
+        v = -v;
+    }
+    if ((v - v) != 0.0) {				// Only infinity minus itself is not zero.
+        strcpy(buf, "inf");
+        return;
+    }
+    if (v != 0.0) {
+        while (v >= 10.0) {
+            v /= 10.0;
+            ++exp;
+        }
+        while (v < 1.0) {
+            v *= 10.0;
+            --exp;
+        }
+    }
+    m = (unsigned long)(v * 1e6 + 0.5);
+    if (m >= 10000000UL) {				// Rounded up to 10.
+        m /= 10UL;
+        ++exp;
+    }
+    for (i = 7; i >= 0; --i) {
+        if (1 == i)
+            buf[i] = '.';
+        else {
+            buf[i] = (char)('0' + m % 10UL);
+            m /= 10UL;
+        }
+    }
+    buf += 8;
+    *buf++ = 'e';
+    *buf++ = (exp < 0) ? '-' : '+';
+    if (exp < 0)
+        exp = -exp;
+    if (exp >= 100)
+        *buf++ = (char)('0' + exp / 100);
+    *buf++ = (char)('0' + exp / 10 % 10);
+    *buf++ = (char)('0' + exp % 10);
+    *buf = '\0';
+}
+
+// Values match if equal, which includes infinities of the same sign, if within the tolerance, or if both are NaN.
+static int float_matches(float a, float e, float tolerance) {
+    float d;
+    if (a == e)							// Else the difference of two infinities would be NaN.
+        return 1;
+    d = (a > e) ? (a - e) : (e - a);
+    return (d <= tolerance) || ((a != a) && (e != e));
+}
+
+void ttAssertFloats(const float* actual, const float* expected, size_t n, float tolerance, tt_pgm_str_t name, tt_pgm_str_t filename, int lineno) {
+    size_t i, first;
+    unsigned long nbad = 0UL;
+    char tol[16];
+
+    for (i = 0; i < n; ++i)
+        nbad += (unsigned long)!float_matches(actual[i], expected[i], tolerance);
+    if (0UL == nbad)
+        return;
+
+    for (first = 0; float_matches(actual[first], expected[first], tolerance); ++first)
+        ;
+    format_double(tol, tolerance);
+    tt_print_fail_message(filename, lineno, TT_PSTR("Expected `" TT_FMT_PSTR "' to match within %s, %lu of %lu values differ, first at index %lu"), 
+      name, tol, nbad, (unsigned long)n, (unsigned long)first);
+#ifndef TT_WANT_TOKENS
+    if ((TT_OUTPUT_MODE_DEFAULT == f_ctx.output_mode) || (TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode)) {
+        size_t start = (first > TT_FLOAT_WINDOW / 2) ? (first - TT_FLOAT_WINDOW / 2) : 0;
+        size_t end = ((n - start) < TT_FLOAT_WINDOW) ? n : (start + TT_FLOAT_WINDOW);
+        for (i = start; i < end; ++i) {
+            char a[16], e[16];
+            format_double(a, actual[i]);
+            format_double(e, expected[i]);
+            tt_printf(TT_PSTR("  %c [%lu] expected %s, actual %s" TT_NEWLINE), float_matches(actual[i], expected[i], tolerance) ? ' ' : '*', 
+              (unsigned long)i, e, a);
+        }
+    }
+#endif
+    tt_abort(TINY_TEST_FAIL);
+}
+
+void tt_print_double(double v) {
+    char buf[16];
+    format_double(buf, v);
+    tt_printf(TT_PSTR("%s"), buf);
+}
+
+/* Property tests. Every value a property draws comes from a stream of bytes, which are made by a xorshift generator & recorded, or are 
+	replayed from a buffer, which is how a failing input is shrunk & how a fuzzer drives the property. Bytes past the end of a replayed 
+	buffer are zero, & a zero byte always gives the simplest value, so removing & reducing bytes makes simpler inputs. */
+#ifndef TT_PROP_MAX_BYTES
+#define TT_PROP_MAX_BYTES 1024			// Bytes drawn by one run of a property, any more are zero.
+#endif
+#ifndef TT_PROP_SHRINK_RUNS
+#define TT_PROP_SHRINK_RUNS 5000		// Limit on runs of the property while shrinking a failing input.
+#endif
+
+struct tt_prop {
+    const unsigned char* data;          // Bytes being replayed, or recorded in buf.
+    unsigned char* buf;                 // Non-NULL if generating.
+    size_t len;                         // Bytes in data.
+    size_t pos;                         // Bytes drawn so far.
+    unsigned long state, word;          // Generator, & the word that bytes are taken from.
+    unsigned nword;                     // Bytes left in word.
+};
+
+static void prop_generate(tt_prop_t* p, unsigned char* buf, unsigned long seed) {
+    p->data = p->buf = buf;
+    p->len = p->pos = 0;
+    p->nword = 0;
+    p->state = seed * 2654435761UL + 0x9e3779b9UL;		// Spread small seeds, never zero.
+    if (0UL == p->state)
+        p->state = 1UL;
+}
+
+static void prop_replay(tt_prop_t* p, const unsigned char* data, size_t len) {
+    p->data = data;
+    p->buf = NULL;
+    p->len = len;
+    p->pos = 0;
+}
+
+static unsigned long prop_next(tt_prop_t* p) {
+    unsigned long x = p->state;
+#if ULONG_MAX > 0xffffffffUL
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+#else
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+#endif
+    p->state = x;
+    return x;
+}
+
+// Non-zero if the next bytes are generated, rather than replayed or past the end.
+static int prop_generating(const tt_prop_t* p, size_t n) {
+    return (NULL != p->buf) && (p->pos == p->len) && ((p->len + n) <= TT_PROP_MAX_BYTES);
+}
+
+static unsigned prop_byte(tt_prop_t* p) {
+    if (p->pos < p->len)
+        return p->data[p->pos++];
+    if (!prop_generating(p, 1)) {
+        p->pos += 1;
+        return 0U;
+    }
+    if (0U == p->nword) {
+        p->word = prop_next(p);
+        p->nword = sizeof(unsigned long);
+    }
+    p->buf[p->len] = (unsigned char)p->word;
+    p->word >>= 8;
+    p->nword -= 1U;
+    p->pos = ++p->len;
+    return p->buf[p->len - 1];
+}
+
+long ttPropInt(tt_prop_t* p, long lo, long hi) {
+    unsigned long span = (unsigned long)hi - (unsigned long)lo;
+    unsigned long v = 0UL, s;
+    size_t n = 0;
+
+    if (hi <= lo)
+        return lo;
+    for (s = span; s > 0UL; s >>= 8)
+        ++n;
+    if (prop_generating(p, n)) {
+        unsigned long r = prop_next(p);
+        if (0UL == (r & 31UL)) {		// Boundary values are likely to find bugs, so 1 in 32 draws is one, recorded as it would be read.
+            long x;
+            size_t i;
+            switch ((r >> 5) & 3UL) {
+            case 0: x = lo; break;
+            case 1: x = hi; break;
+            case 2: x = ((lo < 0) && (hi > 0)) ? 0 : (lo + 1); break;
+            default: x = hi - 1; break;
+            }
+            for (v = (unsigned long)x - (unsigned long)lo, i = n; i > 0; v >>= 8)
+                p->buf[p->len + --i] = (unsigned char)v;
+            p->pos = p->len += n;
+            return x;
+        }
+    }
+    for (s = span; s > 0UL; s >>= 8)
+        v = (v << 8) | prop_byte(p);
+    if (span < ULONG_MAX)
+        v %= span + 1UL;
+    return (long)((unsigned long)lo + v);
+}
+
+size_t ttPropBytes(tt_prop_t* p, void* buf, size_t max_len) {
+    size_t i, n = (size_t)ttPropInt(p, 0L, (long)max_len);
+    for (i = 0; i < n; ++i)
+        ((unsigned char*)buf)[i] = (unsigned char)prop_byte(p);
+    return n;
+}
+
+char* ttPropString(tt_prop_t* p, char* buf, size_t size) {
+    size_t i, n = (size > 0) ? (size_t)ttPropInt(p, 0L, (long)size - 1L) : 0;
+    for (i = 0; i < n; ++i)				// Printable ASCII, a zero byte gives an `a'.
+        buf[i] = (char)(' ' + (prop_byte(p) + ('a' - ' ')) % 95U);
+    if (size > 0)
+        buf[n] = '\0';
+    return buf;
+}
+
+void ttSetPropertySeed(unsigned long seed) {
+    f_ctx.prop_seed = seed;
+}
+
+// The input of the property being checked & the test's jump point, which each run of the property overwrites. Static so that a test's 
+//  stack is not grown by the size of the input, one per thread as tests may run on several.
+static TT_THREAD_LOCAL struct {
+    unsigned char buf[TT_PROP_MAX_BYTES];
+    jmp_buf here;
+} prop_ctx;
+
+// Run the property once, returns one of TINY_TEST_xxx.
+static int prop_call(tt_prop_func_t func, tt_prop_t* p) {
+    int exc = setjmp(t_ctx.here);
+    if (TINY_TEST_SUCCESS == exc)
+        func(p);
+    return exc;
+}
+
+// Run the property with the first trial_len bytes of buf, if it fails len is cut to the bytes that were drawn. Returns non-zero if it failed.
+static int prop_try(tt_prop_func_t func, const unsigned char* buf, size_t* len, size_t trial_len, unsigned long* runs) {
+    tt_prop_t p;
+    *runs += 1UL;
+    prop_replay(&p, buf, trial_len);
+    if (TINY_TEST_FAIL != prop_call(func, &p))
+        return 0;
+    *len = (p.pos < trial_len) ? p.pos : trial_len;
+    return 1;
+}
+
+/* Shrink a failing input, by deleting runs of bytes, then zeroing them, then reducing each byte with a binary search, until nothing
+	makes it smaller. Each trial changes buf in place & is undone if the property passes. Each change makes the input shorter or 
+	smaller, so this ends. */
+static size_t prop_shrink(tt_prop_func_t func, unsigned char* buf, size_t len) {
+    unsigned char saved[8];
+    unsigned long runs = 0UL;
+    int improved = 1;
+    size_t i, k;
+
+    while (improved && (runs < TT_PROP_SHRINK_RUNS)) {
+        improved = 0;
+        for (k = 8; k > 0; k /= 2) {
+            for (i = 0; ((i + k) <= len) && (runs < TT_PROP_SHRINK_RUNS); ) {
+                size_t n = len;
+                memcpy(saved, buf + i, k);
+                memmove(buf + i, buf + i + k, n - i - k);
+                if (prop_try(func, buf, &len, n - k, &runs))
+                    improved = 1;
+                else {
+                    memmove(buf + i + k, buf + i, n - i - k);
+                    memcpy(buf + i, saved, k);
+                    ++i;
+                }
+            }
+        }
+        for (k = 8; k > 0; k /= 2) {
+            for (i = 0; ((i + k) <= len) && (runs < TT_PROP_SHRINK_RUNS); i += k) {
+                size_t j;
+                for (j = i; (j < (i + k)) && (0 == buf[j]); ++j)
+                    ;
+                if (j == (i + k))
+                    continue;
+                memcpy(saved, buf + i, k);
+                memset(buf + i, 0, k);
+                if (prop_try(func, buf, &len, len, &runs))
+                    improved = 1;
+                else
+                    memcpy(buf + i, saved, k);
+            }
+        }
+        for (i = 0; (i < len) && (runs < TT_PROP_SHRINK_RUNS); ++i) {
+            unsigned lo = 0U, hi = buf[i];	// The value at lo passes & the value at hi fails.
+            while (((lo + 1U) < hi) && (i < len) && (runs < TT_PROP_SHRINK_RUNS)) {
+                unsigned mid = (lo + hi) / 2U;
+                buf[i] = (unsigned char)mid;
+                if (prop_try(func, buf, &len, len, &runs)) {
+                    hi = mid;
+                    improved = 1;
+                }
+                else {
+                    buf[i] = (unsigned char)hi;
+                    lo = mid;
+                }
+            }
+        }
+    }
+    return len;
+}
+
+void ttCheckProperty(tt_prop_func_t func, unsigned long iterations) {
+    unsigned char* buf = prop_ctx.buf;
+    unsigned long seed = f_ctx.prop_seed, i;
+    size_t len = 0, generated;
+    int exc = TINY_TEST_SUCCESS;
+    tt_prop_t p;
+#ifdef tt_clock
+    tt_clock_t start = tt_clock();
+#endif
+
+#ifdef tt_clock
+    if (0UL == seed)					// A new seed each run, unless one is given to reproduce a failure.
+        seed = (unsigned long)start * 2654435761UL;
+#endif
+    memcpy(prop_ctx.here, t_ctx.here, sizeof(jmp_buf));
+    prop_replay(&p, buf, 0);
+    f_quiet = 1;
+    for (i = 0; (i < iterations) && (TINY_TEST_SUCCESS == exc); ++i) {
+        prop_generate(&p, buf, seed + i);
+        exc = prop_call(func, &p);
+        if (TINY_TEST_IGNORED == exc)	// An input that the property cannot use, so try another.
+            exc = TINY_TEST_SUCCESS;
+    }
+    generated = len = (p.pos < p.len) ? p.pos : p.len;
+    if (TINY_TEST_FAIL == exc)
+        len = prop_shrink(func, buf, len);
+    f_quiet = 0;
+    memcpy(t_ctx.here, prop_ctx.here, sizeof(jmp_buf));
+
+    if (TINY_TEST_SUCCESS == exc) {
+#if defined(tt_clock) && !defined(TT_WANT_TOKENS)
+        if (TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode) {
+            tt_clock_t elapsed = tt_clock() - start;
+            tt_printf(TT_PSTR("# Property passed %lu iterations, %lu/s." TT_NEWLINE), iterations, 
+              (elapsed > 0) ? (unsigned long)((unsigned long long)iterations * 1000000ULL / elapsed) : 0UL);
         }
-        ++cbuf;
+#endif
+        return;
+    }
+    if (TINY_TEST_FAIL == exc) {		// Run the shrunk input with output, so that it fails the test as usual.
+        prop_replay(&p, buf, len);
+        exc = prop_call(func, &p);
+        memcpy(t_ctx.here, prop_ctx.here, sizeof(jmp_buf));
+        if (TINY_TEST_SUCCESS == exc)
+            tt_print_fail_message(t_ctx.tf_filename, t_ctx.tf_lineno, TT_PSTR("Property failed, but passed with the shrunk input"));
+#ifdef TT_WANT_TOKENS
+        if (TT_OUTPUT_MODE_QUIET != f_ctx.output_mode) {		// The decoder prints the seed.
+            token_start(TT_TOKEN_PROPERTY);
+            token_put32(i - 1UL);
+            token_put32(seed + i - 1UL);
+            token_put32(((seed + i - 1UL) >> 16) >> 16);		// Two shifts as unsigned long may be 32 bits.
+            token_put32((unsigned long)generated);
+            token_put32((unsigned long)len);
+        }
+#else
+        if ((TT_OUTPUT_MODE_DEFAULT == f_ctx.output_mode) || (TT_OUTPUT_MODE_VERBOSE == f_ctx.output_mode))
+            tt_printf(TT_PSTR("# Property failed at iteration %lu with seed %lu, rerun with `-S %lu'. Input shrunk from %lu to %lu bytes." 
+              TT_NEWLINE), i - 1UL, seed + i - 1UL, seed + i - 1UL, (unsigned long)generated, (unsigned long)len);
+#endif
+        if (TINY_TEST_SUCCESS == exc)
+            exc = TINY_TEST_FAIL;
+    }
+    tt_abort(exc);
+}
+
+int ttFuzzOne(tt_prop_func_t func, const unsigned char* data, size_t size, tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc) {
+    tt_prop_t p;
+    if (TT_OUTPUT_MODE_QUIET == f_ctx.output_mode)		// Not started.
+        f_ctx.output_mode = TT_OUTPUT_MODE_DEFAULT;
+    t_ctx.tf_filename = filename;
+    t_ctx.tf_lineno = lineno;
+    t_ctx.test_desc = desc;
+    prop_replay(&p, data, size);
+    if (TINY_TEST_FAIL == prop_call(func, &p)) {
+#if defined(TT_WANT_FORK) || defined(TT_WANT_FILES)
+        fflush(stdout);
+#endif
+        abort();						// So the fuzzer saves the input.
     }
+    return 0;
 }
 
 // eof
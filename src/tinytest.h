@@ -36,6 +36,45 @@
 #include <string.h>
 #define tt_strcmp_pstr(_ps, _s) strcmp(_ps, _s)
 #endif
+#ifndef tt_pgm_read_mem
+#include <string.h>
+#define tt_pgm_read_mem(_d, _s, _n) memcpy(_d, _s, _n)
+#endif
+
+// Type returned by the tt_clock() timer, which counts microseconds.
+#ifndef tt_clock_t
+#define tt_clock_t unsigned long
+#endif
+
+// Timing features are available if there is a clock.
+#if defined(tt_clock) || defined(TT_CLOCK_POSIX)
+#define TT_HAVE_CLOCK
+#endif
+
+// Allocation tracking is available if the allocator calls ttNoteAlloc() & ttNoteFree().
+#if defined(TT_WANT_ALLOC) || defined(TT_ALLOC_WRAP)
+#define TT_HAVE_ALLOC
+#endif
+
+// Budget assertions are available if there is a cycle counter.
+#if defined(tt_cycles) || defined(TT_CYCLES_RDTSC) || defined(TT_CYCLES_DWT) || defined(TT_CYCLES_POSIX)
+#define TT_HAVE_CYCLES
+#endif
+
+// Stack measurement is available if the stack bounds are known.
+#if defined(tt_stack_bounds) || defined(TT_STACK_PTHREAD)
+#define TT_HAVE_STACK
+#endif
+
+// Watchdog timeouts are available if there is a watchdog.
+#if defined(tt_watchdog_start) || defined(TT_WATCHDOG_POSIX)
+#define TT_HAVE_WATCHDOG
+#endif
+
+// Coverage of each test is available if the counters can be reset & dumped, & results files are wanted.
+#if (defined(tt_coverage_reset) || defined(TT_COVERAGE_GCOV) || defined(TT_COVERAGE_LLVM)) && defined(TT_WANT_FILES)
+#define TT_HAVE_COVERAGE
+#endif
 
 // Get the filename for a file in one place only. This save a lot of space compared with using __FILE__, which is the full path.
 #define TT_DECLARE_MODULE(name_) static tt_pgm_str_t TT_FILENAME = TT_PSTR(name_)
@@ -71,14 +110,23 @@ Magic:
 	functions to run those tests. This requires the use of special macros that are read by the script, and used to build the source file.
 	In general function declarations are autogenerated, so test files do not need header files.
 	
-	All files matching the pattern 'test*.c' are scanned. 
+	All files matching the pattern 'test*.c' are scanned. The results are cached in `.mk_test.cache', so only changed files are scanned
+	again, & `mk_test.autogen.h' is only written if it changes, so that the runner is not rebuilt for nothing.
+	With `mk_test.py --units' the code for each test file goes in its own unit `mk_test_<file>.autogen.c', & `mk_test.autogen.h' only 
+	calls them, so editing one test file only recompiles one small unit. The units are listed as MK_TEST_UNITS in `mk_test.autogen.mk',
+	for make to include. Each unit only includes tinytest.h, so test files must use TT_INCLUDE_EXTRA for any types in their parameters.
 	Any function definitions matching `void testXXX()' are considered tests and are run directly.
 	Any function definitions matching `void testXXX(args)` are considered parameterised tests and use the TT_TEST_CASE() macro to
-	generate a stub function with signature `void f(void)' that can be run as a test. Note that the arguments should be constants 
-	if possible.
+	add a case to a table of arguments that is run by ttRunTestTable(). The arguments must be constants, as the table is a const array,
+	& the parameter types must be simple declarations like `int a' or `const char* s'.
 	
+	Any function definitions matching `void benchXXX(tt_bench_t* b)' are considered benchmarks, and are run by ttRunBench().
 	The macros TT_BEGIN_FIXTURE(setup, teardown) & TT_END_FIXTURE() use fixture functions for all tests. 
+	  TT_BEGIN_FIXTURE(setup, teardown, setup_once, teardown_once) also makes the tests up to TT_END_FIXTURE() a suite. 
 	The macro TT_DUMP_FUNC(dumper) sets a dump function, which must be externally linked. 
+	The macro TT_TIMEOUT(ms) sets the watchdog timeout for the next test function, and all its test cases. 
+	The macro TT_TEST_VECTORS(func, path, size) runs func for each record in a file with ttRunTestVectors().
+	The macro TT_SERIAL() marks the next test function, and all its test cases, as not safe to run at the same time as other tests. 
 	The macro TT_IGNORE_FILE aborts scanning of the rest of the file. 
 	The macro TT_INCLUDE_EXTRA may be used to include header files into the autogenerated file.
 */	
@@ -91,6 +139,130 @@ void ttStart(int output_mode, const char* groupstr);
 // Function that runs the tests. Either write it manually or use the code generator. 
 void ttRunTests(void);
 
+/* Only run shard (from 1) of a number of shards of the selected tests, e.g. on several CI machines. Every selected test is given to 
+	one shard, the same way on every run, as long as the shards run the same build with the same groupstr. If a baseline with test
+	times has been read with ttReadBaseline() then the shards are balanced by time, all shards must use the same baseline, else tests
+	are dealt out in turn. Call after ttStart() & ttReadBaseline(), as it may call ttRunTests() to count the tests without running 
+	them. Results files from the shards are combined with `mk_test.py --merge'. */
+void ttSetShard(int shard, int shards);
+
+#ifdef TT_WANT_FORK
+/* Run the tests in ttRunTests() spread over a number of forked worker processes. Results & output are returned to this process
+	and printed in the same order as a serial run. A value of jobs less than 2 just calls ttRunTests(). Only available on
+	POSIX systems, where output goes to stdout. */
+void ttRunTestsParallel(int jobs);
+
+/* If set run each test in a child forked from this process, so that a test that crashes or calls exit() is reported as a
+	failure and the remaining tests still run. Changes made by a test to global state are not seen by later tests. */
+void ttSetIsolation(int enable);
+#endif
+
+#ifdef TT_WANT_THREADS
+/* Run the tests in ttRunTests() on a pool of threads in this process, which suits tests that share expensive read-only setup. Output
+	is captured & printed in the same order as a serial run, which needs tinytest's own vprintf. Tests that are not thread safe must be
+	marked with ttSetNextSerial(). A value of threads less than 2 just calls ttRunTests(). */
+void ttRunTestsThreaded(int threads);
+
+/* Stress test for concurrent code, called from a test. Calls func(thread, iteration) for iterations on each of nthreads threads, which
+	are released together so that they contend. Assertions work on the threads, the first failure stops the other threads & fails the
+	test with the thread & iteration. This is done with 1, 2, 4... up to nthreads threads, verbose mode prints the operations per second
+	for each & the scaling compared with one thread. Allocations made by the threads are not tracked. */
+typedef void (*tt_concurrent_func_t)(int thread, unsigned long iteration);
+void ttRunConcurrent(tt_concurrent_func_t func, int nthreads, unsigned long iterations);
+#endif
+
+// Mark the next test passed to ttRunTest() as serial, it is never run at the same time as any other test. See TT_SERIAL().
+void ttSetNextSerial(void);
+
+#ifdef TT_HAVE_CLOCK
+// Fail any test that takes longer than this many microseconds, including setup & teardown. Zero disables the limit.
+void ttSetTimeLimit(tt_clock_t limit_us);
+#endif
+
+#ifdef TT_HAVE_STACK
+/* Fail any test that uses more than this many bytes of stack, including setup & teardown, measured from where ttRunTest() calls 
+	the test. Zero disables the limit. */
+void ttSetStackLimit(unsigned long limit_bytes);
+#endif
+
+#ifdef TT_HAVE_WATCHDOG
+/* Stop any test that runs for longer than this many milliseconds, including setup but not teardown, and count it as timed out. 
+	Unlike the time limit this stops a test that never returns. Zero disables the watchdog, which is the default. */
+void ttSetTimeout(unsigned long timeout_ms);
+
+// Override the timeout for the next test passed to ttRunTest() only, zero disables the watchdog for that test. See TT_TIMEOUT().
+void ttSetNextTimeout(unsigned long timeout_ms);
+#else
+#define ttSetNextTimeout(timeout_ms_) ((void)(timeout_ms_))		// So that generated code builds without a watchdog.
+#endif
+
+#ifdef TT_HAVE_ALLOC
+/* Allocation tracking. The allocator calls these for every block allocated or freed, TT_ALLOC_WRAP does this for the standard 
+	allocator. Allocations made while a test is running, including setup & teardown, are counted, and a test that passes but has not 
+	freed all its blocks after teardown fails with a leak. */
+void ttNoteAlloc(void* p, size_t size);
+void ttNoteFree(void* p);
+
+// Number of allocations & peak bytes in use so far in the current test.
+unsigned long ttAllocCount(void);
+unsigned long ttAllocPeak(void);
+
+// Fail if the statements in the argument allocate any memory, e.g. TT_ASSERT_NO_ALLOC(foo_update(&foo, 1, 2)); 
+#define TT_ASSERT_NO_ALLOC(...) do { \
+  unsigned long _tt__allocs = ttAllocCount(); \
+  __VA_ARGS__; \
+  if (ttAllocCount() != _tt__allocs) { \
+    tt_print_fail_message(TT_FILENAME, __LINE__, TT_PSTR("Expected no allocations, got %lu"), ttAllocCount() - _tt__allocs); \
+    tt_abort(TINY_TEST_FAIL); \
+  } \
+} while (0)
+
+// Fail if the peak memory in use so far in the test is more than max_ bytes.
+#define TT_ASSERT_MAX_ALLOC_BYTES(max_) do { \
+  if (ttAllocPeak() > (unsigned long)(max_)) { \
+    tt_print_fail_message(TT_FILENAME, __LINE__, TT_PSTR("Expected peak allocation <= %lu bytes, got %lu"), (unsigned long)(max_), ttAllocPeak()); \
+    tt_abort(TINY_TEST_FAIL); \
+  } \
+} while (0)
+#endif
+
+/* Called by the watchdog when a test has run for too long, from a timer ISR or signal handler. Does not return, the test is 
+	abandoned and the teardown function is called. */
+void ttWatchdogExpired(void);
+
+#ifdef TT_WANT_FILES
+/* Write the results of all tests & benchmarks to a file, which is closed by ttFinish(). The file is tab separated text with a 
+	version header. Call after ttStart(). Returns zero on success. */
+int ttWriteResults(const char* filename);
+
+/* Read benchmark results from a file written by a previous run. Benchmarks with a median time slower than the baseline by more than
+	threshold_percent, and by more than the measurement noise, are remeasured and fail if still slow. Call after ttStart(). Returns 
+	zero on success, or non-zero if the file cannot be read or threshold_percent is negative. */
+int ttReadBaseline(const char* filename, int threshold_percent);
+
+/* Read the tests that failed or timed out in the last run from a small file, which is rewritten by ttFinish() with the tests that 
+	failed in this run, & those that failed last time & were not run this time, e.g. as they were not selected. A missing file is 
+	an empty list. Tests are keyed by filename, line number & description, with each case of a table described as "name[index]". 
+	Call after ttStart(). Returns zero on success. ttMain() only calls this, so only touches the file, with -F or -L. */
+int ttReadLastFailed(const char* filename);
+
+/* Select tests by whether they failed in the last run, as well as by groupstr. To run failed tests first call ttRunTests() with 
+	TT_LAST_FAILED_ONLY, then again with TT_LAST_FAILED_OTHERS. Resets the count of tests for ttSetShard(), so each shard gets the 
+	same tests as usual. */
+enum { TT_LAST_FAILED_ALL, TT_LAST_FAILED_ONLY, TT_LAST_FAILED_OTHERS };
+void ttSelectLastFailed(int which);
+#endif
+
+#ifdef TT_HAVE_COVERAGE
+/* Capture the coverage of each test. The counters are reset before the setup of each test, & dumped after teardown to the directory
+	`dir/<pid>-<count>', named for the process that ran the test & a count of the tests it has run, & a tab separated line 
+	"<pid>-<count> <filename> <line number> <description>" is added to `dir/tests'. The directory must not exist, as counters dumped 
+	to an existing directory are added to the old ones. The suite fixtures are covered by the first test of the suite that each 
+	process runs, even if setup_once failed. `mk_test.py --impact' reads it to select the tests that cover changed lines. Not with 
+	ttRunTestsThreaded(), as the counters are shared by the threads. Call after ttStart(). Returns zero on success. */
+int ttCaptureCoverage(const char* dir);
+#endif
+
 // Finish performing tests, and print a summary message. 
 int ttFinish(void);
 
@@ -116,9 +288,24 @@ void ttRegisterFixture(tt_fixture_func_t setup, tt_fixture_func_t dump, tt_fixtu
 
 #define ttUnregisterFixture() ttRegisterFixture(NULL, NULL, NULL)
 
+/* Suite fixtures for expensive setup shared by a block of tests, e.g. loading a large table. Between ttBeginSuite() & ttEndSuite() 
+	setup_once is called before the first selected test, & teardown_once after the last, so neither is called if no test in the block
+	is selected. If setup_once fails every test in the block fails without being run, & teardown_once is not called. Either may be 
+	NULL. A failure in teardown_once is counted as a failure. */
+void ttBeginSuite(tt_fixture_func_t setup_once, tt_fixture_func_t teardown_once);
+void ttEndSuite(void);
+
 /** Emit a diagnostic message (if non-NULL). The string should not contain a trailing newline, as the function 
-	will print one. The message is processed by printf, so arguments can be inserted. */
+	will print one. The message is processed by printf, so arguments can be inserted. 
+	In tokenized mode this is a macro, the message must be a string literal and the arguments must be int sized. */
+#ifdef TT_WANT_TOKENS
+#define ttDiagnostic(msg_, ...) tt_token_diagnostic(TT_FILENAME, __LINE__, TT_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+#else
 void ttDiagnostic(tt_pgm_str_t msg, ...);
+#endif
+
+// Printf for use in dump functions, uses the printf set by TT_VPRINTF in tinytest_local.h, or the internal minimal printf.
+void tt_printf(tt_pgm_str_t fmt, ...);
 
 // Call a test function with an explicit description. The lineno argument is the first line of the function. 
 void ttRunTest(void (*test_func)(void), tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc);
@@ -126,10 +313,193 @@ void ttRunTest(void (*test_func)(void), tt_pgm_str_t filename, int lineno, tt_pg
 // Basic command to run a test function and fill in the filename, line number & description. 
 #define TT_TEST_SIMPLE(x_) 	ttRunTest(x_, TT_FILENAME, __LINE__, TT_PSTR(#x_ "()"))
 
+/* Table driven tests. The cases of a parameterised test are a const array, which is in flash on AVR, & run() is called with the index
+	of each case, it reads the case with tt_pgm_read_mem() & calls the test function. A case is selected & recorded as the table name
+	& its index, e.g. "testFoo()[3]", so `-g testFoo()' selects them all & `-g testFoo()[3]' one, & describe() is only called to print 
+	the arguments of a case when its description is printed, e.g. for a failure, so no description strings are needed. Cases made by the script start with an int line number, else
+	lineno is used for all of them. The watchdog timeout & ttSetNextSerial() apply to every case. */
+typedef struct tt_test_table tt_test_table_t;
+struct tt_test_table {
+    tt_pgm_str_t name;                  // Usually the function name, e.g. "testFoo()".
+    const void* cases;
+    size_t size;                        // Size of one case.
+    unsigned count;
+    int lineno;                         // Line number of all cases, or zero if each case starts with its line number.
+    void (*run)(const tt_test_table_t* table, unsigned index);
+    void (*describe)(const tt_test_table_t* table, unsigned index); // Prints the case, e.g. "testFoo(1, 2)". May be NULL.
+    void* user;                         // For the use of run() & describe().
+};
+void ttRunTestTable(const tt_test_table_t* table, tt_pgm_str_t filename);
+
+#ifdef TT_WANT_REGISTRY
+/* Tests registered with TT_TEST(name) { ... }, which needs TT_DECLARE_MODULE() first. Each has a const descriptor in the linker 
+	section `tt_tests', so there is no list of tests to write or generate, & nothing is done at startup. The tests are run in the 
+	order of the section by ttRunRegisteredTests(), which is the default ttRunTests(), & are numbered from zero in that order. The
+	order is fixed for a build, but the compiler may not keep the order of the source, e.g. GCC reverses it with optimisation. 
+	Descriptors are read with tt_pgm_read_mem(), so on AVR the section may be put in flash by the linker script, which must then 
+	define the symbols `__start_tt_tests' & `__stop_tt_tests' that the GNU linker makes on other targets. If the linker removes unused sections then 
+	the section must be kept, e.g. with `KEEP(*(tt_tests))'. */
+typedef struct {
+    void (*test_func)(void);
+    tt_pgm_str_t* filename;             // The module's TT_FILENAME.
+    int lineno;
+    tt_pgm_str_t desc;
+} tt_test_desc_t;
+#ifndef TT_ATTR_REGISTRY
+#define TT_ATTR_REGISTRY __attribute__((used, section("tt_tests"), aligned(__alignof__(tt_test_desc_t))))
+#endif
+#define TT_TEST(name_) \
+  static void name_(void); \
+  static const char name_##_tt_desc[] TT_ATTR_PGM = #name_ "()"; \
+  static const tt_test_desc_t name_##_tt_reg TT_ATTR_REGISTRY = { name_, &TT_FILENAME, __LINE__, name_##_tt_desc }; \
+  static void name_(void)
+
+// Run all registered tests, or only the one set by ttSelectRegisteredTest(). 
+void ttRunRegisteredTests(void);
+
+// Number of registered tests.
+unsigned ttRegisteredTestCount(void);
+
+// Print the index, filename, line number & description of each registered test.
+void ttListRegisteredTests(void);
+
+/* Only run the registered test with this index, without matching descriptions, & no other tests. All tests run if index is negative.
+	Returns non-zero, & changes nothing, if there is no test with the index. */
+int ttSelectRegisteredTest(int index);
+#endif
+
+#ifdef TT_WANT_FILES
+/* Run test_func for each record in a file of test vectors, which is memory mapped. If size is non-zero the file is an array of binary 
+	records of that size, else each line is a record, e.g. CSV, without the line ending. Empty lines & lines starting with `#' are 
+	skipped. Failures are described as "name[path:N]", where N is the record index for a binary file or the line number for a text 
+	file. If the file cannot be read a single failing test is run. The file stays mapped until ttFinish(). */
+typedef void (*tt_vector_func_t)(const void* record, size_t size);
+void ttRunTestVectors(tt_vector_func_t test_func, const char* path, size_t size, tt_pgm_str_t filename, int lineno, tt_pgm_str_t name);
+#endif
+
+/* Property tests. A property function draws its inputs from p & checks them with the TT_ASSERT_xxx macros, TT_IGNORE() rejects an input.
+	ttCheckProperty() is called from a test, it runs the property for iterations with inputs from a fast generator. If the property 
+	fails the input is shrunk while the property still fails, then it is run once more with the shrunk input, which fails the test as 
+	usual, followed by the seed of the failing iteration. The seed is new for each run unless it is set with ttSetPropertySeed(), e.g. 
+	with `-S', which reproduces the failure at the first iteration. Without tt_clock there is nothing to make a new seed from, so it is 
+	zero unless it is set, & every run draws the same inputs. Output from the property is only seen for the last run. The input is 
+	held in a static buffer of TT_PROP_MAX_BYTES, one per thread with TT_WANT_THREADS, rather than on the test's stack. 
+
+	static void reverseTwice(tt_prop_t* p) {
+		char s[32], r[32];
+		ttPropString(p, s, sizeof(s));
+		TT_ASSERT_STR(reverse(reverse(s, r), r), s);
+	}
+	void testReverse() { ttCheckProperty(reverseTwice, 100000); }
+
+	Values shrink towards lo, & buffers & strings towards being short. The same property is a libFuzzer target with TT_FUZZ_TARGET(),
+	which defines LLVMFuzzerTestOneInput() if TT_FUZZING is defined. Build the file with TT_FUZZING & tinytest.c with -fsanitize=fuzzer, 
+	with ttRunTests() but without a main(). The fuzzer's data are the bytes that the property draws, a failure prints the message & 
+	calls abort(). */
+typedef struct tt_prop tt_prop_t;
+typedef void (*tt_prop_func_t)(tt_prop_t* p);
+void ttCheckProperty(tt_prop_func_t func, unsigned long iterations);
+void ttSetPropertySeed(unsigned long seed);
+long ttPropInt(tt_prop_t* p, long lo, long hi);						// A value from lo to hi inclusive.
+size_t ttPropBytes(tt_prop_t* p, void* buf, size_t max_len);			// Fills up to max_len bytes & returns the length.
+char* ttPropString(tt_prop_t* p, char* buf, size_t size);				// A printable string of up to size - 1 chars.
+int ttFuzzOne(tt_prop_func_t func, const unsigned char* data, size_t size, tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc);
+
+#ifdef TT_FUZZING
+#ifdef __cplusplus
+#define TT_FUZZ_EXTERN extern "C"
+#else
+#define TT_FUZZ_EXTERN
+#endif
+#define TT_FUZZ_TARGET(func_) \
+  TT_FUZZ_EXTERN int LLVMFuzzerTestOneInput(const unsigned char* data, size_t size); \
+  TT_FUZZ_EXTERN int LLVMFuzzerTestOneInput(const unsigned char* data, size_t size) { \
+    return ttFuzzOne(func_, data, size, TT_FILENAME, __LINE__, TT_PSTR(#func_ "()")); \
+  }
+#else
+#define TT_FUZZ_TARGET(func_) /* empty */
+#endif
+
+#ifdef TT_HAVE_CLOCK
+/* Benchmarks. A benchmark function runs the code being measured `b->iterations' times, Tinytest calibrates the number of iterations
+	so that each sample takes a reasonable time, runs some warmup samples, then prints the median, minimum & median absolute 
+	deviation of the time per iteration over a number of samples. Benchmarks are only run in benchmark mode, where tests are not run. 
+	Benchmarks are selected with the groupstr in the same way as tests, and may use the TT_ASSERT_xxx macros & fixture functions.
+	
+	void benchFoo(tt_bench_t* b) { 
+		unsigned long i; 
+		for (i = 0; i < b->iterations; ++i) {
+			int r = foo();
+			TT_DO_NOT_OPTIMIZE(r);
+		}
+	}
+*/
+typedef struct {
+	unsigned long iterations;	// Number of times to run the code being measured.
+} tt_bench_t;
+
+// Set benchmark mode, in which ttRunBench() runs benchmarks and ttRunTest() does nothing, the default is the other way round.
+void ttSetBenchMode(int enable);
+
+// Call a benchmark function with an explicit description.
+void ttRunBench(void (*bench_func)(tt_bench_t*), tt_pgm_str_t filename, int lineno, tt_pgm_str_t desc);
+
+// Basic command to run a benchmark function and fill in the filename, line number & description. 
+#define TT_BENCH_SIMPLE(x_) ttRunBench(x_, TT_FILENAME, __LINE__, TT_PSTR(#x_ "()"))
+#endif
+
+/* Optimisation barriers for benchmarks. TT_DO_NOT_OPTIMIZE(x) forces the value x to be computed, TT_CLOBBER_MEMORY() forces all 
+	pending writes to memory to be done. For compilers other than GCC & Clang, x must be an lvalue. */
+#if defined(__GNUC__)
+#define TT_DO_NOT_OPTIMIZE(x_) __asm__ __volatile__("" : : "g"(x_) : "memory")
+#define TT_CLOBBER_MEMORY() __asm__ __volatile__("" : : : "memory")
+#else
+void tt_bench_escape(const void* p);
+#define TT_DO_NOT_OPTIMIZE(x_) tt_bench_escape((const void*)&(x_))
+#define TT_CLOBBER_MEMORY() tt_bench_escape(NULL)
+#endif
+
 /*
 	These functions/macros should only be used within the body of a test function.
 */
 
+#ifdef TT_WANT_TOKENS
+/* Tokenized output. Failure messages only send the format ID, the file & line of the failure and the values, the text of the 
+	expression that failed is recovered from the source by the decoder in mk_test.py. */
+#define TT_FAIL(msg_) do { \
+    tt_token_fail(TT_FILENAME, __LINE__, TT_TOKEN_FMT_FAIL, 0);  \
+    tt_abort(TINY_TEST_FAIL);         \
+} while (0)
+
+#define TT_ASSERT(cond_) if (cond_) {} else do { \
+    tt_token_fail(TT_FILENAME, __LINE__, TT_TOKEN_FMT_ASSERT, 0); \
+    tt_abort(TINY_TEST_FAIL);         \
+ } while (0)
+
+#define TT_ASSERT_TOKEN(type_, fmt_id_, value_, expected_) do { \
+  const type_ _tt__value = (type_)(value_); \
+  const type_ _tt__expected = (type_)(expected_); \
+  if (_tt__value == _tt__expected) {} else {  \
+    tt_token_fail(TT_FILENAME, __LINE__, fmt_id_, 2, (long)_tt__expected, (long)_tt__value); \
+    tt_abort(TINY_TEST_FAIL);         \
+  } \
+} while (0)
+#define TT_ASSERT_GENERIC(type_, fmt_, value_, expected_) TT_ASSERT_TOKEN(type_, TT_TOKEN_FMT_ASSERT_INT, value_, expected_)
+#define TT_ASSERT_INT(value_, expected_) TT_ASSERT_TOKEN(tt_int_t, TT_TOKEN_FMT_ASSERT_INT, value_, expected_)
+#define TT_ASSERT_INT_HEX(value_, expected_) TT_ASSERT_TOKEN(tt_int_t, TT_TOKEN_FMT_ASSERT_HEX, value_, expected_)
+
+#define TT_ASSERT_STR(value_, expected_) do { \
+  const char* _tt__value = (value_); \
+  tt_pgm_str_t _tt__expected = TT_PSTR(expected_); \
+  if (0 == tt_strcmp_pstr(_tt__expected, _tt__value)) {} else { \
+    tt_token_fail(TT_FILENAME, __LINE__, TT_TOKEN_FMT_ASSERT_STR, 0); \
+    tt_token_string(_tt__value); \
+    tt_abort(TINY_TEST_FAIL);         \
+  } \
+} while (0)
+
+#else
+
 // Cause an explicit test failure. 
 #define TT_FAIL(msg_) do { \
     tt_print_fail_message(TT_FILENAME, __LINE__,  TT_PSTR("Failure: " TT_FMT_PSTR), msg_);  \
@@ -164,32 +534,137 @@ void ttRunTest(void (*test_func)(void), tt_pgm_str_t filename, int lineno, tt_pg
     tt_abort(TINY_TEST_FAIL);         \
   } \
 } while (0)
+#endif // TT_WANT_TOKENS
 
 /* If the test has not failed so far, cause the test function to be flagged as ignored. Called by the TT_IGNORE()
     macro. */
 #define TT_IGNORE() tt_abort(TINY_TEST_IGNORED) 
 
-// A little helper function for checking that a memory buffer has not been corrupted by filling it with random values. Set seed to any value you like. 
+#ifdef TT_HAVE_CYCLES
+/* Budget assertions. The block following the macro is run TT_BUDGET_REPEATS times & the test fails if the median time, less the 
+	overhead of the loop, is over the budget. So the block must be safe to run more than once. For example:
+		TT_ASSERT_MAX_CYCLES(200) { 
+			isr_uart_rx(); 
+		} 
+	TT_ASSERT_MAX_NS() is the same in nanoseconds, which needs `tt_ns()' or `TT_CYCLES_POSIX'. */
+#ifndef TT_BUDGET_REPEATS
+#define TT_BUDGET_REPEATS 11
+#endif
+enum { TT_BUDGET_CYCLES, TT_BUDGET_NS };
+#define TT_ASSERT_MAX_CYCLES(budget_) \
+  for (tt_budget_start(TT_BUDGET_CYCLES); tt_budget_next((budget_), TT_FILENAME, __LINE__); )
+#if defined(tt_ns) || defined(TT_CYCLES_POSIX)
+#define TT_ASSERT_MAX_NS(budget_) \
+  for (tt_budget_start(TT_BUDGET_NS); tt_budget_next((budget_), TT_FILENAME, __LINE__); )
+#endif
+void tt_budget_start(int kind);
+int tt_budget_next(unsigned long budget, tt_pgm_str_t filename, int lineno);
+#endif
+
+/* A little helper function for checking that a memory buffer has not been corrupted by filling it with random values. Set seed to any 
+	value you like. The pattern depends on the address, so verify the same buffer. Does not use rand(). */
 void ttFillMemory(void* buf, size_t len, int seed);
 
-// Macro to verify that the buffer has not been written to. 
-#define TT_VERIFY_MEMORY(buf_, len_, seed_) tt_verify_memory((buf_), (len_), (seed_), TT_FILENAME, __LINE__)
+// Macro to verify that the buffer has not been written to. Fails with every corrupted range of addresses & a hex dump of each. 
+#define TT_VERIFY_MEMORY(buf_, len_, seed_) ttVerifyMemory((buf_), (len_), (seed_), TT_FILENAME, __LINE__)
 
 // Factor for the TT_VERIFY_MEMORY() macro. 
 void ttVerifyMemory(const void* buf, size_t len, int seed, tt_pgm_str_t filename, int lineno);
 
+/* Guard zones for catching buffer overruns & underruns. Put the buffer in the middle of a larger one with guard_len bytes either side,
+	fill the guards with ttFillGuards(), run the code, then check with TT_VERIFY_GUARDS(). For example: 
+		char mem[TT_GUARD_SIZE + 100 + TT_GUARD_SIZE]; 
+		char* buf = mem + TT_GUARD_SIZE;
+		ttFillGuards(buf, 100, TT_GUARD_SIZE); 
+		foo_format(buf, 100); 
+		TT_VERIFY_GUARDS(buf, 100, TT_GUARD_SIZE); */
+#ifndef TT_GUARD_SIZE
+#define TT_GUARD_SIZE 16
+#endif
+#ifndef TT_GUARD_SEED
+#define TT_GUARD_SEED 0x6a4d
+#endif
+void ttFillGuards(void* buf, size_t len, size_t guard_len);
+#define TT_VERIFY_GUARDS(buf_, len_, guard_len_) ttVerifyGuards((buf_), (len_), (guard_len_), TT_FILENAME, __LINE__)
+void ttVerifyGuards(const void* buf, size_t len, size_t guard_len, tt_pgm_str_t filename, int lineno);
+
+/* Compare large buffers, e.g. image frames. Fails with the first mismatching offset, the number of bytes that differ & a hex dump of 
+	both buffers around the first difference. */
+#define TT_ASSERT_MEM(actual_, expected_, len_) ttAssertMem((actual_), (expected_), (len_), TT_PSTR(#actual_), TT_FILENAME, __LINE__)
+void ttAssertMem(const void* actual, const void* expected, size_t len, tt_pgm_str_t name, tt_pgm_str_t filename, int lineno);
+
+/* Compare arrays of n floats, e.g. DSP output. Values differing by more than tolerance fail, NaN only matches NaN. Fails with the first
+	mismatching index, the number of values that differ & the values around the first difference. */
+#define TT_ASSERT_FLOATS(actual_, expected_, n_, tolerance_) \
+  ttAssertFloats((actual_), (expected_), (n_), (tolerance_), TT_PSTR(#actual_), TT_FILENAME, __LINE__)
+void ttAssertFloats(const float* actual, const float* expected, size_t n, float tolerance, tt_pgm_str_t name, tt_pgm_str_t filename, int lineno);
+
 /*
     These should not be called directly. 
 */
-enum { TINY_TEST_SUCCESS, TINY_TEST_FAIL, TINY_TEST_IGNORED };
+enum { TINY_TEST_SUCCESS, TINY_TEST_FAIL, TINY_TEST_IGNORED, TINY_TEST_TIMEOUT };
 void tt_print_fail_message(tt_pgm_str_t filename, int lineno, tt_pgm_str_t msg, ...);
 void tt_abort(int reason);
+void tt_print_double(double v);		// For describe functions of test tables.
+
+#ifdef TT_WANT_TOKENS
+/* Tokenized output. Each record is the sync byte TT_TOKEN_SYNC, a record type, then fields as below. Words are 16 bit for file IDs, 
+	line numbers & counts, 32 bit for argument values, all little endian. A file ID is a hash of the filename, see tt_token_file_id(). 
+	Anything outside a record is plain text. The decoder is `mk_test.py --decode'.
+		TT_TOKEN_TEST		file, line						Start of test. 
+		TT_TOKEN_CASE		index							Follows TT_TOKEN_TEST for a case of a table, index is a word.
+		TT_TOKEN_RESULT		result							Test passed or ignored, TINY_TEST_SUCCESS or TINY_TEST_IGNORED as a byte.
+		TT_TOKEN_FAIL		format, file, line, n, n*arg	Failure message, format is a TT_TOKEN_FMT_xxx byte, n is a byte.
+		TT_TOKEN_STRING		chars, nul						String argument for the previous record.
+		TT_TOKEN_DIAG		file, line, n, n*arg			Diagnostic, n is a byte. 
+		TT_TOKEN_SUMMARY	pass, fail, ignore, timeout		From ttFinish(). 
+		TT_TOKEN_SLOW		file, line, time				One of the slowest tests, sent by ttFinish(), time is 32 bit microseconds.
+		TT_TOKEN_TIME		total, tests					Total time & time in tests, sent before the summary, 32 bit microseconds.
+		TT_TOKEN_PROPERTY	iteration, seed, from, to		A property failed, seed is 64 bits, from & to are the input sizes, all 32 bit.
+		TT_TOKEN_STATS		flags, n*value					Measurements of a test in verbose mode, flags is a byte with a TT_TOKEN_STAT_xxx bit 
+															set for each group of 32 bit values that follows, in the order of the bits.
+		TT_TOKEN_ALLOCS		file, line, allocs, bytes, peak	Allocation totals from ttFinish(), with the test with the highest peak, all 32 bit.
+		TT_TOKEN_STACK		file, line, bytes				Deepest stack from ttFinish(), 32 bit.
+		TT_TOKEN_BENCH		file, line, median, min, MAD, iterations, samples, baseline
+															Benchmark result, times are 64 bit picoseconds per iteration, iterations is 32 bit,
+															samples is a word, baseline is the median from the baseline file or zero.
+	Performance counters are not sent.
+*/
+#define TT_TOKEN_SYNC 0xa5
+enum { TT_TOKEN_TEST = 1, TT_TOKEN_RESULT, TT_TOKEN_FAIL, TT_TOKEN_STRING, TT_TOKEN_DIAG, TT_TOKEN_SUMMARY, TT_TOKEN_SLOW, TT_TOKEN_TIME, TT_TOKEN_PROPERTY,
+	TT_TOKEN_STATS, TT_TOKEN_ALLOCS, TT_TOKEN_STACK, TT_TOKEN_BENCH, TT_TOKEN_CASE };
+enum { 
+	TT_TOKEN_STAT_TIME = 1,			// Wall time, microseconds.
+	TT_TOKEN_STAT_CPU = 2,			// CPU time, microseconds.
+	TT_TOKEN_STAT_ALLOC = 4,		// Allocations, bytes allocated & peak bytes in use.
+	TT_TOKEN_STAT_STACK = 8,		// Stack bytes used.
+};
+enum { 
+	TT_TOKEN_FMT_TEXT,				// Text formatted by the target follows in a TT_TOKEN_STRING record.
+	TT_TOKEN_FMT_FAIL,				// From TT_FAIL().
+	TT_TOKEN_FMT_ASSERT,			// From TT_ASSERT().
+	TT_TOKEN_FMT_ASSERT_INT,		// From TT_ASSERT_INT(), args expected & actual.
+	TT_TOKEN_FMT_ASSERT_HEX,		// From TT_ASSERT_INT_HEX(), args expected & actual, then the field width of TT_FMT_HEX.
+	TT_TOKEN_FMT_ASSERT_STR,		// From TT_ASSERT_STR(), actual value follows in a TT_TOKEN_STRING record.
+};
+void tt_token_fail(tt_pgm_str_t filename, int lineno, int fmt_id, int nargs, ...);		// Arguments are long.
+void tt_token_string(const char* str);
+void tt_token_diagnostic(tt_pgm_str_t filename, int lineno, int nargs, ...);			// Arguments are int.
+unsigned tt_token_file_id(tt_pgm_str_t filename);
+
+// Count arguments, up to 8.
+#define TT_NARGS(...) TT_NARGS_(_, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define TT_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n_, ...) n_
+#endif
 
 // The script that builds a runtests() function uses these pseudo-macros in the test code. The definitions turn them into no-ops. 
 #define TT_TEST_CASE(...) // empty 
-#define TT_BEGIN_FIXTURE(a, b) // empty 
+#define TT_BEGIN_FIXTURE(...) // empty 
 #define TT_END_FIXTURE() // empty 
 #define TT_DUMP_FUNC(a) // empty 
 #define TT_INCLUDE_EXTRA(a) // empty 
+#define TT_TIMEOUT(ms) // empty 
+#define TT_SERIAL() // empty 
+#define TT_TEST_VECTORS(...) // empty 
 
 #endif // TINYTEST_H__ 